@@ -0,0 +1,64 @@
+/**
+ * @file bench_context_switch.cpp
+ * @brief 协程切换基准：resume/yield往返延迟
+ * @details 一个协程不停yield，主协程不停resume，测量一次往返（两次切换）
+ * 的延迟。分别以-DEVENT_COR_FCONTEXT和不带该宏编译，对比汇编切换
+ * 和ucontext切换的开销
+ * @version 0.1
+ * @date 2024-06-08
+ */
+
+#include "../m_cor.h"
+#include "bench_util.h"
+
+static const uint64_t kIterations = 1000000;
+static const uint64_t kSamples = 100000;
+
+/// 协程入口：一直yield，直到被告知退出
+static bool s_done = false;
+static void switch_loop()
+{
+    while (!s_done)
+    {
+        event::Cor::GetThis()->yield();
+    }
+}
+
+int main()
+{
+    event::Cor::GetThis(); // 初始化主协程
+
+    event::Cor::ptr cor(new event::Cor(switch_loop));
+
+    // 预热
+    for (int i = 0; i < 10000; i++)
+    {
+        cor->resume();
+    }
+
+    // 吞吐：总时间/迭代次数
+    uint64_t start = bench::NowNs();
+    for (uint64_t i = 0; i < kIterations; i++)
+    {
+        cor->resume();
+    }
+    uint64_t elapsed = bench::NowNs() - start;
+    // 一次resume对应yield回来，即2次上下文切换
+    bench::ReportOps("resume_yield_roundtrip", kIterations, elapsed);
+
+    // 延迟分位数：逐次计时
+    std::vector<uint64_t> samples;
+    samples.reserve(kSamples);
+    for (uint64_t i = 0; i < kSamples; i++)
+    {
+        uint64_t t0 = bench::NowNs();
+        cor->resume();
+        samples.push_back(bench::NowNs() - t0);
+    }
+    bench::ReportLatency("resume_yield_roundtrip", samples);
+
+    // 让协程正常结束
+    s_done = true;
+    cor->resume();
+    return 0;
+}
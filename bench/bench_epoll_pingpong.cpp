@@ -0,0 +1,70 @@
+/**
+ * @file bench_epoll_pingpong.cpp
+ * @brief epoll事件分发基准：socketpair乒乓
+ * @details 一对socketpair上两个协程互相回显1字节，每个回合经过
+ * addEvent注册、epoll_wait就绪、triggerEvent调度各两次，
+ * 测量events/sec和单回合延迟分位数
+ * @version 0.1
+ * @date 2024-06-08
+ */
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../iomanager.h"
+#include "bench_util.h"
+
+static const uint64_t kRounds = 100000;
+
+int main()
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+    {
+        perror("socketpair");
+        return 1;
+    }
+
+    event::IOManager iom(2, false, "bench");
+
+    std::vector<uint64_t> samples;
+    samples.reserve(kRounds);
+
+    std::atomic<bool> done{false};
+
+    // 回显端：读1字节原样写回
+    iom.schedule(std::function<void()>([&]()
+                                       {
+        char c;
+        for (uint64_t i = 0; i < kRounds; i++)
+        {
+            // hook生效，read/write在fd未就绪时自动挂起协程
+            if (read(fds[1], &c, 1) != 1) { break; }
+            if (write(fds[1], &c, 1) != 1) { break; }
+        } }));
+
+    // 发起端：写1字节等回显，计时
+    iom.schedule(std::function<void()>([&]()
+                                       {
+        char c = 'x';
+        uint64_t start = bench::NowNs();
+        for (uint64_t i = 0; i < kRounds; i++)
+        {
+            uint64_t t0 = bench::NowNs();
+            if (write(fds[0], &c, 1) != 1) { break; }
+            if (read(fds[0], &c, 1) != 1) { break; }
+            samples.push_back(bench::NowNs() - t0);
+        }
+        uint64_t elapsed = bench::NowNs() - start;
+        // 每回合4次事件（两端各一读一写）
+        bench::ReportOps("epoll_pingpong_rounds", kRounds, elapsed);
+        bench::ReportLatency("epoll_pingpong_round", samples);
+        done = true; }));
+
+    while (!done)
+    {
+        usleep(10 * 1000);
+    }
+    close(fds[0]);
+    close(fds[1]);
+    return 0;
+}
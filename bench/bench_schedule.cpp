@@ -0,0 +1,68 @@
+/**
+ * @file bench_schedule.cpp
+ * @brief 调度吞吐基准：schedule()提交+执行空任务的总吞吐
+ * @details 在1/2/4/8/16/32个调度线程下各跑一轮，每轮由多个生产者线程
+ * 并发schedule空回调，测量全部任务执行完的总吞吐。用于对比单队列
+ * 模式和工作窃取模式（work_steal=true）的扩展性
+ * @version 0.1
+ * @date 2024-06-08
+ */
+
+#include <atomic>
+#include <thread>
+#include "../scheduler.h"
+#include "bench_util.h"
+
+static const uint64_t kTasksPerProducer = 200000;
+static const int kProducers = 4;
+
+static std::atomic<uint64_t> s_executed{0};
+
+static void run_round(size_t threads, bool work_steal)
+{
+    s_executed = 0;
+    event::Scheduler sc(threads, false, "bench", work_steal);
+    sc.start();
+
+    uint64_t total = kTasksPerProducer * kProducers;
+    uint64_t start = bench::NowNs();
+
+    // 多个生产者并发提交空任务
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; p++)
+    {
+        producers.emplace_back([&sc]()
+                               {
+            for (uint64_t i = 0; i < kTasksPerProducer; i++)
+            {
+                sc.schedule(std::function<void()>([]() { ++s_executed; }));
+            } });
+    }
+    for (auto &t : producers)
+    {
+        t.join();
+    }
+
+    // 等全部任务执行完
+    while (s_executed.load(std::memory_order_relaxed) < total)
+    {
+        std::this_thread::yield();
+    }
+    uint64_t elapsed = bench::NowNs() - start;
+    sc.stop();
+
+    char name[64];
+    snprintf(name, sizeof(name), "schedule_%zut_%s", threads,
+             work_steal ? "worksteal" : "single");
+    bench::ReportOps(name, total, elapsed);
+}
+
+int main()
+{
+    for (size_t threads : {1, 2, 4, 8, 16, 32})
+    {
+        run_round(threads, false);
+        run_round(threads, true);
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file bench_util.h
+ * @brief 微基准公共工具
+ * @details 计时、吞吐和延迟分位数统计，供bench目录下的各个基准使用
+ * @version 0.1
+ * @date 2024-06-08
+ */
+
+#ifndef __EVENT_BENCH_UTIL_H__
+#define __EVENT_BENCH_UTIL_H__
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+
+    /**
+     * @brief 当前时间，纳秒
+     */
+    inline uint64_t NowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    /**
+     * @brief 打印吞吐结果
+     * @param[in] name 基准名称
+     * @param[in] ops 总操作数
+     * @param[in] elapsed_ns 总耗时(纳秒)
+     */
+    inline void ReportOps(const std::string &name, uint64_t ops, uint64_t elapsed_ns)
+    {
+        double sec = elapsed_ns / 1e9;
+        printf("%-32s %12lu ops %10.3f s %14.0f ops/sec %10.1f ns/op\n",
+               name.c_str(), (unsigned long)ops, sec, ops / sec,
+               (double)elapsed_ns / ops);
+    }
+
+    /**
+     * @brief 打印延迟分位数，samples会被排序
+     * @param[in] name 基准名称
+     * @param[in,out] samples 单次操作的延迟样本(纳秒)
+     */
+    inline void ReportLatency(const std::string &name, std::vector<uint64_t> &samples)
+    {
+        if (samples.empty())
+        {
+            return;
+        }
+        std::sort(samples.begin(), samples.end());
+        auto pct = [&](double p) -> uint64_t
+        {
+            size_t idx = (size_t)(p * (samples.size() - 1));
+            return samples[idx];
+        };
+        printf("%-32s p50 %8lu ns  p90 %8lu ns  p99 %8lu ns  p999 %8lu ns  max %8lu ns\n",
+               name.c_str(), (unsigned long)pct(0.50), (unsigned long)pct(0.90),
+               (unsigned long)pct(0.99), (unsigned long)pct(0.999),
+               (unsigned long)samples.back());
+    }
+
+} // namespace bench
+
+#endif
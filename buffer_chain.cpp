@@ -0,0 +1,90 @@
+/**
+ * @file buffer_chain.cpp
+ * @brief 零拷贝的分散/聚集IO缓冲链实现
+ * @version 0.1
+ * @date 2024-06-13
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include "buffer_chain.h"
+
+namespace event
+{
+
+    void BufferChain::append(const void *data, size_t len)
+    {
+        if (len == 0)
+        {
+            return;
+        }
+        iovec iov;
+        iov.iov_base = const_cast<void *>(data);
+        iov.iov_len = len;
+        m_iovs.push_back(iov);
+        m_bytes += len;
+    }
+
+    ssize_t BufferChain::writeFd(int fd)
+    {
+        ssize_t total = 0;
+        while (m_cur < m_iovs.size())
+        {
+            size_t cnt = m_iovs.size() - m_cur;
+            if (cnt > IOV_MAX)
+            {
+                cnt = IOV_MAX;
+            }
+            // hook开启时这里是协程化的writev，EAGAIN在hook内部转为
+            // 注册WRITE事件+yield，返回时要么写出了数据要么真的出错
+            ssize_t n = ::writev(fd, &m_iovs[m_cur], (int)cnt);
+            if (n < 0)
+            {
+                return total > 0 ? total : -1;
+            }
+            total += n;
+            m_bytes -= n;
+            // 按内核实际接受的字节数推进，写了一半的段原地调整
+            while (n > 0)
+            {
+                iovec &iov = m_iovs[m_cur];
+                if ((size_t)n >= iov.iov_len)
+                {
+                    n -= iov.iov_len;
+                    ++m_cur;
+                }
+                else
+                {
+                    iov.iov_base = (char *)iov.iov_base + n;
+                    iov.iov_len -= n;
+                    n = 0;
+                }
+            }
+        }
+        return total;
+    }
+
+    ssize_t BufferChain::readFd(int fd)
+    {
+        if (m_cur >= m_iovs.size())
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        size_t cnt = m_iovs.size() - m_cur;
+        if (cnt > IOV_MAX)
+        {
+            cnt = IOV_MAX;
+        }
+        return ::readv(fd, &m_iovs[m_cur], (int)cnt);
+    }
+
+    void BufferChain::clear()
+    {
+        m_iovs.clear();
+        m_cur = 0;
+        m_bytes = 0;
+    }
+
+} /// end namespace event
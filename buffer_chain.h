@@ -0,0 +1,87 @@
+/**
+ * @file buffer_chain.h
+ * @brief 零拷贝的分散/聚集IO缓冲链
+ * @version 0.1
+ * @date 2024-06-13
+ */
+
+#ifndef __EVENT_BUFFER_CHAIN_H__
+#define __EVENT_BUFFER_CHAIN_H__
+
+#include <memory>
+#include <sys/uio.h>
+#include <vector>
+
+namespace event
+{
+
+    /**
+     * @brief 零拷贝的IO缓冲链，配合hook后的readv/writev做协程化的分散/聚集IO
+     * @details 一个逻辑报文往往由多段缓冲区组成（头部+正文+尾部），
+     * 逐段write每段都要走一次系统调用和一轮事件注册/唤醒；BufferChain
+     * 只记录各段的地址和长度（不拷贝数据），writeFd用一次writev提交
+     * 整条链，单次就绪内尽量多地写出，部分写入时原地推进iovec，
+     * 只有内核返回EAGAIN才经由hook注册一次WRITE事件并yield。
+     * 链只引用缓冲区不持有所有权，调用者需保证IO完成前各段有效
+     */
+    class BufferChain
+    {
+    public:
+        typedef std::shared_ptr<BufferChain> ptr;
+
+        /**
+         * @brief 追加一段缓冲区到链尾，只记录引用，不拷贝
+         * @param[] data 缓冲区起始地址
+         * @param[] len 缓冲区字节数，为0时忽略
+         */
+        void append(const void *data, size_t len);
+
+        /**
+         * @brief 把链上未写出的部分全部写入fd
+         * @details 循环调用writev（hook开启时为协程化版本，EAGAIN时
+         * 注册WRITE事件并yield，就绪后继续），每次按内核实际接受的
+         * 字节数推进：写完的段跳过，写了一半的段原地调整iov_base/iov_len。
+         * 超过IOV_MAX的链分批提交
+         * @return 成功返回本次写出的总字节数，出错返回-1并置errno，
+         * 已写出的部分不回退，可重新调用继续写剩余部分
+         */
+        ssize_t writeFd(int fd);
+
+        /**
+         * @brief 用一次readv把fd上已就绪的数据分散读入链上各段
+         * @details 各段此时作为可写缓冲区使用，单次调用，不保证读满；
+         * hook开启时无数据会注册READ事件并yield。读入不消费链，
+         * 可反复调用复用同一组缓冲区
+         * @return 同readv，返回读到的字节数，0表示对端关闭，-1表示出错
+         */
+        ssize_t readFd(int fd);
+
+        /**
+         * @brief 链上未写出的段数
+         */
+        size_t count() const { return m_iovs.size() - m_cur; }
+
+        /**
+         * @brief 链上未写出的总字节数
+         */
+        size_t bytes() const { return m_bytes; }
+
+        bool empty() const { return m_cur == m_iovs.size(); }
+
+        /**
+         * @brief 清空链，已消费的iovec一并释放，可复用对象拼装下一条报文
+         */
+        void clear();
+
+    private:
+        /// 各段的地址和长度，writeFd部分写入时原地修改
+        std::vector<iovec> m_iovs;
+        /// 第一个未写完的段下标，之前的段已全部写出
+        size_t m_cur = 0;
+        /// 未写出的总字节数
+        size_t m_bytes = 0;
+    };
+
+} /// end namespace event
+
+#endif
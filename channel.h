@@ -0,0 +1,179 @@
+/**
+ * @file channel.h
+ * @brief 协程间通信的有界消息通道
+ * @version 0.1
+ * @date 2024-06-10
+ */
+
+#ifndef __EVENT_CHANNEL_H__
+#define __EVENT_CHANNEL_H__
+
+#include <memory>
+#include <utility>
+#include "co_mutex.h"
+#include "macro.h"
+
+namespace event
+{
+
+    /**
+     * @brief 固定容量的协程消息通道
+     * @details 多级流水线（解析->处理->响应）在协程之间传递数据时，
+     * 如果靠schedule一个新闭包来交接，负载会被拷进闭包，下游变慢时上游
+     * 也毫无感知地继续堆任务。Channel用固定容量的环形缓冲区做交接：
+     * send在通道满时让出执行权，天然形成背压，recv在通道空时让出，
+     * 元素全程move传递，缓冲区不拷贝。等待和唤醒建立在CoMutex/CoCondVar
+     * 之上，多个生产者和多个消费者可以并发使用
+     * @tparam T 元素类型，支持move-only类型
+     * @attention send/recv只能在调度器管理的协程里调用
+     */
+    template <class T>
+    class Channel
+    {
+    public:
+        typedef std::shared_ptr<Channel> ptr;
+
+        /**
+         * @brief 构造函数
+         * @param[in] capacity 通道容量，至少为1
+         */
+        Channel(size_t capacity)
+            : m_capacity(capacity)
+        {
+            EVENT_ASSERT(capacity > 0);
+            m_storage = std::allocator<T>().allocate(capacity);
+        }
+
+        Channel(const Channel &) = delete;
+        Channel &operator=(const Channel &) = delete;
+
+        ~Channel()
+        {
+            // 析构时不应再有协程在send/recv上等待
+            while (m_size > 0)
+            {
+                (m_storage + m_head)->~T();
+                m_head = (m_head + 1) % m_capacity;
+                --m_size;
+            }
+            std::allocator<T>().deallocate(m_storage, m_capacity);
+        }
+
+        /**
+         * @brief 发送一个元素，通道满时当前协程让出执行权
+         * @param[in] value 待发送的元素，move进缓冲区
+         * @return 成功返回true，通道已关闭返回false
+         */
+        bool send(T value)
+        {
+            CoMutex::Lock lock(m_mutex);
+            while (m_size == m_capacity && !m_closed)
+            {
+                m_notFull.wait(m_mutex);
+            }
+            if (m_closed)
+            {
+                return false;
+            }
+            new (m_storage + m_tail) T(std::move(value));
+            m_tail = (m_tail + 1) % m_capacity;
+            ++m_size;
+            // 先放锁再通知，被唤醒的消费者不会立刻又在锁上排队
+            lock.unlock();
+            m_notEmpty.notify();
+            return true;
+        }
+
+        /**
+         * @brief 接收一个元素，通道空时当前协程让出执行权
+         * @param[out] value 收到的元素，从缓冲区move出来
+         * @return 成功返回true，通道已关闭且取空返回false
+         */
+        bool recv(T &value)
+        {
+            CoMutex::Lock lock(m_mutex);
+            while (m_size == 0)
+            {
+                // 关闭后剩余的元素仍可取完，取空才返回失败
+                if (m_closed)
+                {
+                    return false;
+                }
+                m_notEmpty.wait(m_mutex);
+            }
+            value = std::move(*(m_storage + m_head));
+            (m_storage + m_head)->~T();
+            m_head = (m_head + 1) % m_capacity;
+            --m_size;
+            lock.unlock();
+            m_notFull.notify();
+            return true;
+        }
+
+        /**
+         * @brief 关闭通道，唤醒所有等待的协程
+         * @details 关闭后send直接失败，recv可以继续取完缓冲区里的存量
+         */
+        void close()
+        {
+            {
+                CoMutex::Lock lock(m_mutex);
+                if (m_closed)
+                {
+                    return;
+                }
+                m_closed = true;
+            }
+            m_notEmpty.notifyAll();
+            m_notFull.notifyAll();
+        }
+
+        /**
+         * @brief 获取通道中的元素个数
+         */
+        size_t size()
+        {
+            CoMutex::Lock lock(m_mutex);
+            return m_size;
+        }
+
+        /**
+         * @brief 通道是否为空
+         */
+        bool empty()
+        {
+            return size() == 0;
+        }
+
+        /**
+         * @brief 获取通道容量
+         */
+        size_t capacity() const
+        {
+            return m_capacity;
+        }
+
+    private:
+        /// 保护环形缓冲区
+        CoMutex m_mutex;
+        /// 通道不满的条件，send等待
+        CoCondVar m_notFull;
+        /// 通道非空的条件，recv等待
+        CoCondVar m_notEmpty;
+        /// 环形缓冲区，元素原地构造/析构
+        T *m_storage = nullptr;
+        /// 通道容量
+        size_t m_capacity;
+        /// 队头下标
+        size_t m_head = 0;
+        /// 队尾下标
+        size_t m_tail = 0;
+        /// 当前元素个数
+        size_t m_size = 0;
+        /// 是否已关闭
+        bool m_closed = false;
+    };
+
+} /// end namespace event
+
+#endif
@@ -0,0 +1,160 @@
+/**
+ * @file co_mutex.cpp
+ * @brief 协程级同步原语实现
+ * @version 0.1
+ * @date 2024-06-10
+ */
+#include "co_mutex.h"
+#include <sched.h>
+#include "macro.h"
+
+namespace event
+{
+
+    /**
+     * 把等待者重新交给它所属的调度器。
+     * 等待者从入队到切换完成之间还是RUNNING状态，这里自旋等到READY再schedule。
+     * READY由等待者那侧的resume()在swap返回之后才发布（见Cor::resume），
+     * 所以读到READY时它的现场一定已经保存完毕，不存在现场未保存就被
+     * 另一个线程resume的窗口。窗口只有出临界区到切换完成的几条指令，自旋可以忽略不计
+     */
+    static void ScheduleWaiter(std::pair<Cor::ptr, Scheduler *> &waiter)
+    {
+        while (waiter.first->getState() == Cor::RUNNING)
+        {
+            sched_yield();
+        }
+        waiter.second->schedule(waiter.first);
+    }
+
+    void CoMutex::lock()
+    {
+        {
+            MutexType::Lock lock(m_mutex);
+            if (!m_locked)
+            {
+                m_locked = true;
+                return;
+            }
+            EVENT_ASSERT(Scheduler::GetThis());
+            m_waiters.push_back(std::make_pair(Cor::GetThis(), Scheduler::GetThis()));
+        }
+        // 被unlock唤醒时锁的所有权已经移交给本协程，醒来即持有
+        Cor::GetThis()->yield();
+    }
+
+    bool CoMutex::tryLock()
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_locked)
+        {
+            return false;
+        }
+        m_locked = true;
+        return true;
+    }
+
+    void CoMutex::unlock()
+    {
+        std::pair<Cor::ptr, Scheduler *> waiter;
+        {
+            MutexType::Lock lock(m_mutex);
+            EVENT_ASSERT(m_locked);
+            if (m_waiters.empty())
+            {
+                m_locked = false;
+                return;
+            }
+            // 锁不放开，所有权直接移交给队首等待者，m_locked保持true
+            waiter = m_waiters.front();
+            m_waiters.pop_front();
+        }
+        ScheduleWaiter(waiter);
+    }
+
+    void CoSemaphore::wait()
+    {
+        {
+            MutexType::Lock lock(m_mutex);
+            if (m_concurrency > 0)
+            {
+                --m_concurrency;
+                return;
+            }
+            EVENT_ASSERT(Scheduler::GetThis());
+            m_waiters.push_back(std::make_pair(Cor::GetThis(), Scheduler::GetThis()));
+        }
+        // 被notify唤醒时计数已经移交给本协程
+        Cor::GetThis()->yield();
+    }
+
+    bool CoSemaphore::tryWait()
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_concurrency == 0)
+        {
+            return false;
+        }
+        --m_concurrency;
+        return true;
+    }
+
+    void CoSemaphore::notify()
+    {
+        std::pair<Cor::ptr, Scheduler *> waiter;
+        {
+            MutexType::Lock lock(m_mutex);
+            if (m_waiters.empty())
+            {
+                ++m_concurrency;
+                return;
+            }
+            // 计数不入m_concurrency，直接移交给队首等待者
+            waiter = m_waiters.front();
+            m_waiters.pop_front();
+        }
+        ScheduleWaiter(waiter);
+    }
+
+    void CoCondVar::wait(CoMutex &mutex)
+    {
+        {
+            MutexType::Lock lock(m_mutex);
+            EVENT_ASSERT(Scheduler::GetThis());
+            m_waiters.push_back(std::make_pair(Cor::GetThis(), Scheduler::GetThis()));
+        }
+        // 先入队再放锁，晚于入队的notify一定能看到本协程，不会丢通知
+        mutex.unlock();
+        Cor::GetThis()->yield();
+        mutex.lock();
+    }
+
+    void CoCondVar::notify()
+    {
+        std::pair<Cor::ptr, Scheduler *> waiter;
+        {
+            MutexType::Lock lock(m_mutex);
+            if (m_waiters.empty())
+            {
+                return;
+            }
+            waiter = m_waiters.front();
+            m_waiters.pop_front();
+        }
+        ScheduleWaiter(waiter);
+    }
+
+    void CoCondVar::notifyAll()
+    {
+        std::list<std::pair<Cor::ptr, Scheduler *>> waiters;
+        {
+            MutexType::Lock lock(m_mutex);
+            waiters.swap(m_waiters);
+        }
+        for (auto &waiter : waiters)
+        {
+            ScheduleWaiter(waiter);
+        }
+    }
+
+} /// end namespace event
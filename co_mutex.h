@@ -0,0 +1,201 @@
+/**
+ * @file co_mutex.h
+ * @brief 协程级同步原语
+ * @details 协程互斥锁/信号量/条件变量，等待时让出执行权而不是挂起线程
+ * @version 0.1
+ * @date 2024-06-10
+ */
+
+#ifndef __EVENT_CO_MUTEX_H__
+#define __EVENT_CO_MUTEX_H__
+
+#include <list>
+#include <utility>
+#include "m_cor.h"
+#include "scheduler.h"
+
+namespace event
+{
+
+    /**
+     * @brief 协程互斥锁
+     * @details 线程级Mutex在协程里加锁会把整个调度线程挂起，同线程的
+     * 其他协程全部陪着等，持锁协程恰好也在这个线程上时直接死锁。
+     * CoMutex拿不到锁时把当前协程挂到等待队列上yield让出线程，
+     * unlock时把锁的所有权直接移交给队首等待者并将其重新schedule，
+     * 调度线程始终可以去跑别的协程。
+     * 内部用一把线程级Mutex保护锁状态和等待队列，临界区只有几条指令
+     * @attention 只能在调度器管理的协程里使用
+     */
+    class CoMutex
+    {
+    public:
+        typedef std::shared_ptr<CoMutex> ptr;
+
+        CoMutex() = default;
+        CoMutex(const CoMutex &) = delete;
+        CoMutex &operator=(const CoMutex &) = delete;
+
+        /**
+         * @brief 加锁，锁被占用时当前协程让出执行权
+         * @details 被unlock唤醒时锁的所有权已经移交给本协程，醒来即持有
+         */
+        void lock();
+
+        /**
+         * @brief 尝试加锁，不会让出执行权
+         * @return 是否成功拿到锁
+         */
+        bool tryLock();
+
+        /**
+         * @brief 解锁，有等待者时把锁移交给队首的协程并唤醒它
+         */
+        void unlock();
+
+        /**
+         * @brief RAII的局部锁，用法同Mutex::Lock
+         */
+        struct Lock
+        {
+            Lock(CoMutex &mutex)
+                : m_mutex(mutex)
+            {
+                m_mutex.lock();
+                m_locked = true;
+            }
+
+            ~Lock()
+            {
+                unlock();
+            }
+
+            void lock()
+            {
+                if (!m_locked)
+                {
+                    m_mutex.lock();
+                    m_locked = true;
+                }
+            }
+
+            void unlock()
+            {
+                if (m_locked)
+                {
+                    m_mutex.unlock();
+                    m_locked = false;
+                }
+            }
+
+        private:
+            /// 协程互斥锁
+            CoMutex &m_mutex;
+            /// 是否已上锁
+            bool m_locked = false;
+        };
+
+    private:
+        typedef Mutex MutexType;
+        /// 保护锁状态和等待队列
+        MutexType m_mutex;
+        /// 锁是否被持有
+        bool m_locked = false;
+        /// 等待队列，协程和它所属的调度器
+        std::list<std::pair<Cor::ptr, Scheduler *>> m_waiters;
+    };
+
+    /**
+     * @brief 协程信号量
+     * @details 与thread.h里的线程级Semaphore语义一致，区别是wait拿不到
+     * 计数时让出执行权而不是sem_wait挂起线程，notify把计数直接移交给
+     * 队首等待者
+     * @attention 只能在调度器管理的协程里使用
+     */
+    class CoSemaphore
+    {
+    public:
+        typedef std::shared_ptr<CoSemaphore> ptr;
+
+        /**
+         * @brief 构造函数
+         * @param[in] concurrency 信号量初始计数
+         */
+        CoSemaphore(uint32_t concurrency = 0)
+            : m_concurrency(concurrency)
+        {
+        }
+
+        CoSemaphore(const CoSemaphore &) = delete;
+        CoSemaphore &operator=(const CoSemaphore &) = delete;
+
+        /**
+         * @brief 获取信号量，计数为0时当前协程让出执行权
+         */
+        void wait();
+
+        /**
+         * @brief 尝试获取信号量，不会让出执行权
+         * @return 是否成功获取
+         */
+        bool tryWait();
+
+        /**
+         * @brief 释放信号量，有等待者时直接唤醒队首的协程
+         */
+        void notify();
+
+    private:
+        typedef Mutex MutexType;
+        /// 保护计数和等待队列
+        MutexType m_mutex;
+        /// 信号量计数
+        uint32_t m_concurrency;
+        /// 等待队列，协程和它所属的调度器
+        std::list<std::pair<Cor::ptr, Scheduler *>> m_waiters;
+    };
+
+    /**
+     * @brief 协程条件变量
+     * @details 配合CoMutex使用，wait原子地入队并释放互斥锁，被notify
+     * 唤醒后重新拿锁返回。只会被notify/notifyAll唤醒，没有虚假唤醒，
+     * 但按惯例调用方仍应在循环里检查条件
+     * @attention 只能在调度器管理的协程里使用
+     */
+    class CoCondVar
+    {
+    public:
+        typedef std::shared_ptr<CoCondVar> ptr;
+
+        CoCondVar() = default;
+        CoCondVar(const CoCondVar &) = delete;
+        CoCondVar &operator=(const CoCondVar &) = delete;
+
+        /**
+         * @brief 等待通知
+         * @details 当前协程入队后释放mutex并让出执行权，醒来后重新加锁
+         * @param[in] mutex 调用时必须已由当前协程持有
+         */
+        void wait(CoMutex &mutex);
+
+        /**
+         * @brief 唤醒一个等待的协程
+         */
+        void notify();
+
+        /**
+         * @brief 唤醒所有等待的协程
+         */
+        void notifyAll();
+
+    private:
+        typedef Mutex MutexType;
+        /// 保护等待队列
+        MutexType m_mutex;
+        /// 等待队列，协程和它所属的调度器
+        std::list<std::pair<Cor::ptr, Scheduler *>> m_waiters;
+    };
+
+} /// end namespace event
+
+#endif
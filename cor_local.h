@@ -0,0 +1,99 @@
+/**
+ * @file cor_local.h
+ * @brief 协程本地存储
+ * @version 0.1
+ * @date 2024-06-12
+ */
+
+#ifndef __EVENT_COR_LOCAL_H__
+#define __EVENT_COR_LOCAL_H__
+
+#include "m_cor.h"
+
+namespace event
+{
+
+    /**
+     * @brief 协程本地存储，thread_local的协程版
+     * @details 每个请求的上下文（trace id、arena指针、鉴权信息等）需要
+     * 跟着协程走：捕获进闭包每个请求都多一笔分配，thread_local在协程被
+     * 调度到别的线程后直接错位。CorLocal在构造时向Cor注册一个全局槽位
+     * 下标，get()用这个下标O(1)访问当前协程身上的存储，不做哈希查找；
+     * 存储挂在协程对象上，yield/resume跨线程迁移后依然取到同一份。
+     * 值在首次访问时构造，协程结束或被reset复用时自动销毁。
+     * 槽位进程级分配且不回收，CorLocal应定义为全局或静态对象
+     * @tparam T 存储的值类型，需要可默认构造
+     */
+    template <class T>
+    class CorLocal
+    {
+    public:
+        CorLocal()
+            : m_index(Cor::AllocLocalSlot(&CorLocal::Destroy))
+        {
+        }
+
+        CorLocal(const CorLocal &) = delete;
+        CorLocal &operator=(const CorLocal &) = delete;
+
+        /**
+         * @brief 获取当前协程的那份存储，首次访问时默认构造
+         */
+        T &get()
+        {
+            void *&slot = Cor::GetThis()->localSlot(m_index);
+            if (!slot)
+            {
+                slot = new T();
+            }
+            return *static_cast<T *>(slot);
+        }
+
+        /**
+         * @brief 获取当前协程的那份存储的指针，未构造过时返回nullptr
+         */
+        T *getPointer()
+        {
+            return static_cast<T *>(Cor::GetThis()->localSlot(m_index));
+        }
+
+        /**
+         * @brief 替换当前协程的那份存储，接管value的所有权
+         */
+        void reset(T *value)
+        {
+            void *&slot = Cor::GetThis()->localSlot(m_index);
+            if (slot)
+            {
+                delete static_cast<T *>(slot);
+            }
+            slot = value;
+        }
+
+        T &operator*()
+        {
+            return get();
+        }
+
+        T *operator->()
+        {
+            return &get();
+        }
+
+    private:
+        /**
+         * @brief 槽内对象的销毁函数，注册给Cor在协程结束时调用
+         */
+        static void Destroy(void *ptr)
+        {
+            delete static_cast<T *>(ptr);
+        }
+
+    private:
+        /// 本CorLocal占用的槽位下标
+        size_t m_index;
+    };
+
+} /// end namespace event
+
+#endif
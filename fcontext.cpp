@@ -0,0 +1,47 @@
+/**
+ * @file fcontext.cpp
+ * @brief 快速协程上下文的栈初始化实现
+ * @version 0.1
+ * @date 2024-05-25
+ */
+
+#include <cstdint>
+#include <cstring>
+#include "fcontext.h"
+
+namespace event
+{
+
+    void *event_cor_make(void *stack, size_t size, void (*fn)())
+    {
+        /// 栈从高地址向低地址增长，栈顶按16字节对齐，满足两种ABI的要求
+        uintptr_t top = reinterpret_cast<uintptr_t>(stack) + size;
+        top &= ~static_cast<uintptr_t>(15);
+
+#if defined(__x86_64__)
+        /**
+         * 伪造一个event_cor_swap的保存帧：6个被调用者保存寄存器槽位 + 返回地址。
+         * 第一次切换到该协程时，6次pop弹出全0寄存器，ret跳转到fn，
+         * 此时rsp % 16 == 8，与正常call进入函数后的对齐状态一致
+         */
+        uintptr_t sp = top - 8 * 8;
+        memset(reinterpret_cast<void *>(sp), 0, 8 * 8);
+        *reinterpret_cast<void (**)()>(top - 2 * 8) = fn;
+        return reinterpret_cast<void *>(sp);
+#elif defined(__aarch64__)
+        /**
+         * 伪造一个event_cor_swap的保存帧：x19-x28/fp/lr + d8-d15共160字节。
+         * lr槽位（偏移88）填入fn，ret时跳转到入口函数
+         */
+        uintptr_t sp = top - 160;
+        memset(reinterpret_cast<void *>(sp), 0, 160);
+        *reinterpret_cast<void (**)()>(sp + 88) = fn;
+        return reinterpret_cast<void *>(sp);
+#else
+        (void)top;
+        (void)fn;
+        return nullptr;
+#endif
+    }
+
+} // namespace event
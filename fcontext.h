@@ -0,0 +1,50 @@
+/**
+ * @file fcontext.h
+ * @brief 快速协程上下文切换
+ * @details 手写汇编实现的上下文切换例程，只保存/恢复被调用者保存寄存器，
+ * 不涉及信号掩码，避免了swapcontext内部的sigprocmask系统调用。
+ * 定义EVENT_COR_FCONTEXT宏时协程模块使用本实现，否则退回ucontext实现
+ * @version 0.1
+ * @date 2024-05-25
+ */
+
+#ifndef __EVENT_FCONTEXT_H__
+#define __EVENT_FCONTEXT_H__
+
+#include <cstddef>
+
+#if defined(EVENT_COR_FCONTEXT) && !defined(__x86_64__) && !defined(__aarch64__)
+#error "EVENT_COR_FCONTEXT only supports x86-64 and aarch64, use the ucontext fallback"
+#endif
+
+extern "C"
+{
+
+    /**
+     * @brief 上下文切换，语义上等价于swapcontext(from, to)
+     * @details 将被调用者保存寄存器压入当前栈，把栈指针存入*from_sp，
+     * 然后切换到to_sp指向的栈并恢复寄存器。恢复后从对端上次调用
+     * event_cor_swap的位置继续执行（新协程则从入口函数开始执行）
+     * @param[out] from_sp 保存当前协程栈指针的位置
+     * @param[in] to_sp 目标协程的栈指针
+     */
+    void event_cor_swap(void **from_sp, void *to_sp);
+}
+
+namespace event
+{
+
+    /**
+     * @brief 初始化协程栈，语义上等价于makecontext
+     * @details 在栈顶构造一个伪造的event_cor_swap保存帧，使得第一次切换
+     * 到该协程时"恢复"出的执行位置正好是入口函数fn
+     * @param[in] stack 栈底地址（低地址）
+     * @param[in] size 栈大小
+     * @param[in] fn 协程入口函数，不允许返回
+     * @return 切换用的栈指针，交给event_cor_swap的to_sp参数
+     */
+    void *event_cor_make(void *stack, size_t size, void (*fn)());
+
+} // namespace event
+
+#endif
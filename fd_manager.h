@@ -0,0 +1,150 @@
+/**
+ * @file fd_manager.h
+ * @brief 文件句柄管理
+ * @details 记录每个fd的类型、阻塞状态和读写超时，供hook模块判断
+ * 一个fd是否需要走协程化的IO路径
+ * @version 0.1
+ * @date 2024-06-02
+ */
+
+#ifndef __EVENT_FD_MANAGER_H__
+#define __EVENT_FD_MANAGER_H__
+
+#include <memory>
+#include <vector>
+#include "mutex.h"
+#include "singleton.h"
+
+namespace event
+{
+
+    /**
+     * @brief 文件句柄上下文
+     * @details 管理文件句柄类型（是否socket）、是否阻塞、是否关闭、读写超时时间
+     */
+    class FdCtx : public std::enable_shared_from_this<FdCtx>
+    {
+    public:
+        typedef std::shared_ptr<FdCtx> ptr;
+
+        /**
+         * @brief 通过文件句柄构造FdCtx
+         */
+        FdCtx(int fd);
+
+        /**
+         * @brief 析构函数
+         */
+        ~FdCtx();
+
+        /**
+         * @brief 是否初始化完成
+         */
+        bool isInit() const { return m_isInit; }
+
+        /**
+         * @brief 是否是socket
+         */
+        bool isSocket() const { return m_isSocket; }
+
+        /**
+         * @brief 是否已关闭
+         */
+        bool isClose() const { return m_isClosed; }
+
+        /**
+         * @brief 设置用户主动设置的非阻塞标志
+         * @details 用户自己设置了非阻塞的fd，hook直接透传系统调用，不做协程化
+         */
+        void setUserNonblock(bool v) { m_userNonblock = v; }
+
+        /**
+         * @brief 获取用户主动设置的非阻塞标志
+         */
+        bool getUserNonblock() const { return m_userNonblock; }
+
+        /**
+         * @brief 设置hook内部设置的非阻塞标志
+         */
+        void setSysNonblock(bool v) { m_sysNonblock = v; }
+
+        /**
+         * @brief 获取hook内部设置的非阻塞标志
+         */
+        bool getSysNonblock() const { return m_sysNonblock; }
+
+        /**
+         * @brief 设置超时时间
+         * @param[in] type SO_RCVTIMEO(读超时)或SO_SNDTIMEO(写超时)
+         * @param[in] v 超时时间(毫秒)
+         */
+        void setTimeout(int type, uint64_t v);
+
+        /**
+         * @brief 获取超时时间
+         * @param[in] type SO_RCVTIMEO(读超时)或SO_SNDTIMEO(写超时)
+         * @return 超时时间(毫秒)
+         */
+        uint64_t getTimeout(int type);
+
+    private:
+        /**
+         * @brief 初始化，判断fd类型，socket统一设置为非阻塞
+         */
+        bool init();
+
+    private:
+        /// 是否初始化
+        bool m_isInit : 1;
+        /// 是否socket
+        bool m_isSocket : 1;
+        /// 是否hook设置了非阻塞
+        bool m_sysNonblock : 1;
+        /// 是否用户设置了非阻塞
+        bool m_userNonblock : 1;
+        /// 是否已关闭
+        bool m_isClosed : 1;
+        /// 文件句柄
+        int m_fd;
+        /// 读超时时间(毫秒)
+        uint64_t m_recvTimeout;
+        /// 写超时时间(毫秒)
+        uint64_t m_sendTimeout;
+    };
+
+    /**
+     * @brief 文件句柄管理类
+     */
+    class FdManager
+    {
+    public:
+        typedef RWMutex RWMutexType;
+
+        FdManager();
+
+        /**
+         * @brief 获取/创建文件句柄上下文
+         * @param[in] fd 文件句柄
+         * @param[in] auto_create 不存在时是否自动创建
+         * @return 对应的FdCtx，不存在且不自动创建时返回nullptr
+         */
+        FdCtx::ptr get(int fd, bool auto_create = false);
+
+        /**
+         * @brief 删除文件句柄上下文
+         */
+        void del(int fd);
+
+    private:
+        /// 读写锁
+        RWMutexType m_mutex;
+        /// 文件句柄上下文集合
+        std::vector<FdCtx::ptr> m_datas;
+    };
+
+    /// 文件句柄管理类单例
+    typedef Singleton<FdManager> FdMgr;
+
+} // namespace event
+
+#endif
@@ -0,0 +1,596 @@
+/**
+ * @file hook.cpp
+ * @brief 协程化的系统调用hook实现
+ * @version 0.1
+ * @date 2024-06-02
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdarg.h>
+#include "hook.h"
+#include "config.h"
+#include "fd_manager.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+#include "m_cor.h"
+
+namespace event
+{
+
+    static event::Logger::ptr g_logger = EVENT_LOG_NAME("system");
+
+    /// tcp连接超时，connect未显式指定超时时使用
+    static ConfigVar<int>::ptr g_tcp_connect_timeout =
+        Config::Lookup<int>("tcp.connect.timeout", 5000, "tcp connect timeout");
+
+    /// 线程局部变量，当前线程是否开启hook
+    static thread_local bool t_hook_enable = false;
+
+#define HOOK_FUN(XX) \
+    XX(sleep)        \
+    XX(usleep)       \
+    XX(nanosleep)    \
+    XX(socket)       \
+    XX(connect)      \
+    XX(accept)       \
+    XX(read)         \
+    XX(recv)         \
+    XX(recvfrom)     \
+    XX(recvmsg)      \
+    XX(readv)        \
+    XX(write)        \
+    XX(send)         \
+    XX(sendto)       \
+    XX(sendmsg)      \
+    XX(writev)       \
+    XX(close)        \
+    XX(fcntl)        \
+    XX(ioctl)        \
+    XX(getsockopt)   \
+    XX(setsockopt)
+
+    /**
+     * 初始化原始函数指针，main之前由静态对象触发，
+     * dlsym(RTLD_NEXT)拿到的是libc里被我们覆盖掉的那份实现
+     */
+    void hook_init()
+    {
+        static bool is_inited = false;
+        if (is_inited)
+        {
+            return;
+        }
+        is_inited = true;
+#define XX(name) name##_f = (name##_fun)dlsym(RTLD_NEXT, #name);
+        HOOK_FUN(XX)
+#undef XX
+    }
+
+    static uint64_t s_connect_timeout = -1;
+
+    struct _HookIniter
+    {
+        _HookIniter()
+        {
+            hook_init();
+            s_connect_timeout = g_tcp_connect_timeout->getValue();
+            g_tcp_connect_timeout->addListener([](const int &old_value, const int &new_value)
+                                               {
+                EVENT_LOG_INFO(g_logger) << "tcp connect timeout changed from "
+                                         << old_value << " to " << new_value;
+                s_connect_timeout = new_value; });
+        }
+    };
+
+    static _HookIniter s_hook_initer;
+
+    bool is_hook_enable()
+    {
+        return t_hook_enable;
+    }
+
+    void set_hook_enable(bool flag)
+    {
+        t_hook_enable = flag;
+    }
+
+} // namespace event
+
+/**
+ * @brief 条件定时器的条件，超时与事件就绪竞争时用cancelled记录胜负
+ */
+struct timer_info
+{
+    int cancelled = 0;
+};
+
+/**
+ * @brief 协程化IO的通用模板
+ * @details 先直接尝试非阻塞的原始调用，返回EAGAIN说明fd未就绪，
+ * 此时注册fd事件（回调为当前协程）并按FdCtx记录的超时添加条件定时器，
+ * 然后yield让出执行权；事件就绪或超时被resume后重试，直到成功或出错
+ */
+template <typename OriginFun, typename... Args>
+static ssize_t do_io(int fd, OriginFun fun, const char *hook_fun_name,
+                     uint32_t event, int timeout_so, Args &&...args)
+{
+    if (!event::t_hook_enable)
+    {
+        return fun(fd, std::forward<Args>(args)...);
+    }
+
+    event::FdCtx::ptr ctx = event::FdMgr::GetInstance()->get(fd);
+    if (!ctx)
+    {
+        return fun(fd, std::forward<Args>(args)...);
+    }
+
+    if (ctx->isClose())
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    // 不是socket，或者用户自己设置了非阻塞，直接透传
+    if (!ctx->isSocket() || ctx->getUserNonblock())
+    {
+        return fun(fd, std::forward<Args>(args)...);
+    }
+
+    uint64_t to = ctx->getTimeout(timeout_so);
+    std::shared_ptr<timer_info> tinfo(new timer_info);
+
+retry:
+    // fd已经是非阻塞的，先直接试一次
+    ssize_t n = fun(fd, std::forward<Args>(args)...);
+    while (n == -1 && errno == EINTR)
+    {
+        n = fun(fd, std::forward<Args>(args)...);
+    }
+    if (n == -1 && errno == EAGAIN)
+    {
+        event::IOManager *iom = event::IOManager::GetThis();
+        event::Timer::ptr timer;
+        std::weak_ptr<timer_info> winfo(tinfo);
+
+        if (to != (uint64_t)-1)
+        {
+            // 设置了超时的话，添加条件定时器，到期后取消事件并唤醒协程
+            timer = iom->addConditionTimer(to, [winfo, fd, iom, event]()
+                                           {
+                auto t = winfo.lock();
+                if (!t || t->cancelled)
+                {
+                    return;
+                }
+                t->cancelled = ETIMEDOUT;
+                iom->cancelEvent(fd, (event::IOManager::Event)(event)); }, winfo);
+        }
+
+        // cb为空，当前协程作为事件回调，事件就绪后协程被重新调度
+        int rt = iom->addEvent(fd, (event::IOManager::Event)(event));
+        if (EVENT_UNLIKELY(rt))
+        {
+            EVENT_LOG_ERROR(event::g_logger) << hook_fun_name << " addEvent("
+                                             << fd << ", " << event << ")";
+            if (timer)
+            {
+                timer->cancel();
+            }
+            return -1;
+        }
+        else
+        {
+            event::Cor::GetThis()->yield();
+            // 从这里resume有两种情况：事件就绪，或条件定时器超时
+            if (timer)
+            {
+                timer->cancel();
+            }
+            if (tinfo->cancelled)
+            {
+                errno = tinfo->cancelled;
+                return -1;
+            }
+            goto retry;
+        }
+    }
+
+    return n;
+}
+
+extern "C"
+{
+
+#define XX(name) name##_fun name##_f = nullptr;
+    HOOK_FUN(XX)
+#undef XX
+
+    unsigned int sleep(unsigned int seconds)
+    {
+        if (!event::t_hook_enable)
+        {
+            return sleep_f(seconds);
+        }
+
+        // 用定时器重新调度当前协程代替线程级睡眠
+        event::Cor::ptr cor = event::Cor::GetThis();
+        event::IOManager *iom = event::IOManager::GetThis();
+        iom->addTimer(seconds * 1000, std::bind((void (event::Scheduler::*)(event::Cor::ptr, int thread, int priority)) & event::IOManager::schedule, iom, cor, -1, (int)event::Scheduler::PRIO_NORMAL));
+        event::Cor::GetThis()->yield();
+        return 0;
+    }
+
+    int usleep(useconds_t usec)
+    {
+        if (!event::t_hook_enable)
+        {
+            return usleep_f(usec);
+        }
+
+        event::Cor::ptr cor = event::Cor::GetThis();
+        event::IOManager *iom = event::IOManager::GetThis();
+        iom->addTimer(usec / 1000, std::bind((void (event::Scheduler::*)(event::Cor::ptr, int thread, int priority)) & event::IOManager::schedule, iom, cor, -1, (int)event::Scheduler::PRIO_NORMAL));
+        event::Cor::GetThis()->yield();
+        return 0;
+    }
+
+    int nanosleep(const struct timespec *req, struct timespec *rem)
+    {
+        if (!event::t_hook_enable)
+        {
+            return nanosleep_f(req, rem);
+        }
+
+        int timeout_ms = req->tv_sec * 1000 + req->tv_nsec / 1000 / 1000;
+        event::Cor::ptr cor = event::Cor::GetThis();
+        event::IOManager *iom = event::IOManager::GetThis();
+        iom->addTimer(timeout_ms, std::bind((void (event::Scheduler::*)(event::Cor::ptr, int thread, int priority)) & event::IOManager::schedule, iom, cor, -1, (int)event::Scheduler::PRIO_NORMAL));
+        event::Cor::GetThis()->yield();
+        return 0;
+    }
+
+    int socket(int domain, int type, int protocol)
+    {
+        if (!event::t_hook_enable)
+        {
+            return socket_f(domain, type, protocol);
+        }
+        int fd = socket_f(domain, type, protocol);
+        if (fd == -1)
+        {
+            return fd;
+        }
+        // 纳入fd管理，顺便被设置为非阻塞
+        event::FdMgr::GetInstance()->get(fd, true);
+        return fd;
+    }
+
+    int connect_with_timeout(int fd, const struct sockaddr *addr, socklen_t addrlen, uint64_t timeout_ms)
+    {
+        if (!event::t_hook_enable)
+        {
+            return connect_f(fd, addr, addrlen);
+        }
+        event::FdCtx::ptr ctx = event::FdMgr::GetInstance()->get(fd);
+        if (!ctx || ctx->isClose())
+        {
+            errno = EBADF;
+            return -1;
+        }
+
+        if (!ctx->isSocket())
+        {
+            return connect_f(fd, addr, addrlen);
+        }
+
+        if (ctx->getUserNonblock())
+        {
+            return connect_f(fd, addr, addrlen);
+        }
+
+        int n = connect_f(fd, addr, addrlen);
+        if (n == 0)
+        {
+            return 0;
+        }
+        else if (n != -1 || errno != EINPROGRESS)
+        {
+            return n;
+        }
+
+        // 非阻塞connect进行中，等待套接字可写
+        event::IOManager *iom = event::IOManager::GetThis();
+        event::Timer::ptr timer;
+        std::shared_ptr<timer_info> tinfo(new timer_info);
+        std::weak_ptr<timer_info> winfo(tinfo);
+
+        if (timeout_ms != (uint64_t)-1)
+        {
+            timer = iom->addConditionTimer(timeout_ms, [winfo, fd, iom]()
+                                           {
+                auto t = winfo.lock();
+                if (!t || t->cancelled)
+                {
+                    return;
+                }
+                t->cancelled = ETIMEDOUT;
+                iom->cancelEvent(fd, event::IOManager::WRITE); }, winfo);
+        }
+
+        int rt = iom->addEvent(fd, event::IOManager::WRITE);
+        if (rt == 0)
+        {
+            event::Cor::GetThis()->yield();
+            if (timer)
+            {
+                timer->cancel();
+            }
+            if (tinfo->cancelled)
+            {
+                errno = tinfo->cancelled;
+                return -1;
+            }
+        }
+        else
+        {
+            if (timer)
+            {
+                timer->cancel();
+            }
+            EVENT_LOG_ERROR(event::g_logger) << "connect addEvent(" << fd << ", WRITE) error";
+        }
+
+        // 可写不代表连接成功，还要取SO_ERROR确认
+        int error = 0;
+        socklen_t len = sizeof(int);
+        if (-1 == getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len))
+        {
+            return -1;
+        }
+        if (!error)
+        {
+            return 0;
+        }
+        else
+        {
+            errno = error;
+            return -1;
+        }
+    }
+
+    int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen)
+    {
+        return connect_with_timeout(sockfd, addr, addrlen, event::s_connect_timeout);
+    }
+
+    int accept(int s, struct sockaddr *addr, socklen_t *addrlen)
+    {
+        int fd = do_io(s, accept_f, "accept", event::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
+        if (fd >= 0)
+        {
+            // 新连接同样纳入fd管理并设置非阻塞
+            event::FdMgr::GetInstance()->get(fd, true);
+        }
+        return fd;
+    }
+
+    ssize_t read(int fd, void *buf, size_t count)
+    {
+        return do_io(fd, read_f, "read", event::IOManager::READ, SO_RCVTIMEO, buf, count);
+    }
+
+    ssize_t recv(int sockfd, void *buf, size_t len, int flags)
+    {
+        return do_io(sockfd, recv_f, "recv", event::IOManager::READ, SO_RCVTIMEO, buf, len, flags);
+    }
+
+    ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen)
+    {
+        return do_io(sockfd, recvfrom_f, "recvfrom", event::IOManager::READ, SO_RCVTIMEO, buf, len, flags, src_addr, addrlen);
+    }
+
+    ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags)
+    {
+        return do_io(sockfd, recvmsg_f, "recvmsg", event::IOManager::READ, SO_RCVTIMEO, msg, flags);
+    }
+
+    ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+    {
+        return do_io(fd, readv_f, "readv", event::IOManager::READ, SO_RCVTIMEO, iov, iovcnt);
+    }
+
+    ssize_t write(int fd, const void *buf, size_t count)
+    {
+        return do_io(fd, write_f, "write", event::IOManager::WRITE, SO_SNDTIMEO, buf, count);
+    }
+
+    ssize_t send(int s, const void *msg, size_t len, int flags)
+    {
+        return do_io(s, send_f, "send", event::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags);
+    }
+
+    ssize_t sendto(int s, const void *msg, size_t len, int flags, const struct sockaddr *to, socklen_t tolen)
+    {
+        return do_io(s, sendto_f, "sendto", event::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags, to, tolen);
+    }
+
+    ssize_t sendmsg(int s, const struct msghdr *msg, int flags)
+    {
+        return do_io(s, sendmsg_f, "sendmsg", event::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
+    }
+
+    ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+    {
+        return do_io(fd, writev_f, "writev", event::IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);
+    }
+
+    int close(int fd)
+    {
+        if (!event::t_hook_enable)
+        {
+            return close_f(fd);
+        }
+
+        event::FdCtx::ptr ctx = event::FdMgr::GetInstance()->get(fd);
+        if (ctx)
+        {
+            auto iom = event::IOManager::GetThis();
+            if (iom)
+            {
+                // 关闭前触发并清理fd上挂着的所有事件，避免协程悬在已关闭的fd上
+                iom->cancelAll(fd);
+            }
+            event::FdMgr::GetInstance()->del(fd);
+        }
+        return close_f(fd);
+    }
+
+    int fcntl(int fd, int cmd, ... /* arg */)
+    {
+        va_list va;
+        va_start(va, cmd);
+        switch (cmd)
+        {
+        case F_SETFL:
+        {
+            int arg = va_arg(va, int);
+            va_end(va);
+            event::FdCtx::ptr ctx = event::FdMgr::GetInstance()->get(fd);
+            if (!ctx || ctx->isClose() || !ctx->isSocket())
+            {
+                return fcntl_f(fd, cmd, arg);
+            }
+            // 记录用户的非阻塞意图，实际fd始终保持非阻塞
+            ctx->setUserNonblock(arg & O_NONBLOCK);
+            if (ctx->getSysNonblock())
+            {
+                arg |= O_NONBLOCK;
+            }
+            else
+            {
+                arg &= ~O_NONBLOCK;
+            }
+            return fcntl_f(fd, cmd, arg);
+        }
+        break;
+        case F_GETFL:
+        {
+            va_end(va);
+            int arg = fcntl_f(fd, cmd);
+            event::FdCtx::ptr ctx = event::FdMgr::GetInstance()->get(fd);
+            if (!ctx || ctx->isClose() || !ctx->isSocket())
+            {
+                return arg;
+            }
+            // 对用户呈现他自己设置的阻塞状态
+            if (ctx->getUserNonblock())
+            {
+                return arg | O_NONBLOCK;
+            }
+            else
+            {
+                return arg & ~O_NONBLOCK;
+            }
+        }
+        break;
+        case F_DUPFD:
+        case F_DUPFD_CLOEXEC:
+        case F_SETFD:
+        case F_SETOWN:
+        case F_SETSIG:
+        case F_SETLEASE:
+        case F_NOTIFY:
+#ifdef F_SETPIPE_SZ
+        case F_SETPIPE_SZ:
+#endif
+        {
+            int arg = va_arg(va, int);
+            va_end(va);
+            return fcntl_f(fd, cmd, arg);
+        }
+        break;
+        case F_GETFD:
+        case F_GETOWN:
+        case F_GETSIG:
+        case F_GETLEASE:
+#ifdef F_GETPIPE_SZ
+        case F_GETPIPE_SZ:
+#endif
+        {
+            va_end(va);
+            return fcntl_f(fd, cmd);
+        }
+        break;
+        case F_SETLK:
+        case F_SETLKW:
+        case F_GETLK:
+        {
+            struct flock *arg = va_arg(va, struct flock *);
+            va_end(va);
+            return fcntl_f(fd, cmd, arg);
+        }
+        break;
+        case F_GETOWN_EX:
+        case F_SETOWN_EX:
+        {
+            struct f_owner_ex *arg = va_arg(va, struct f_owner_ex *);
+            va_end(va);
+            return fcntl_f(fd, cmd, arg);
+        }
+        break;
+        default:
+            va_end(va);
+            return fcntl_f(fd, cmd);
+        }
+    }
+
+    int ioctl(int d, unsigned long int request, ...)
+    {
+        va_list va;
+        va_start(va, request);
+        void *arg = va_arg(va, void *);
+        va_end(va);
+
+        if (FIONBIO == request)
+        {
+            bool user_nonblock = !!*(int *)arg;
+            event::FdCtx::ptr ctx = event::FdMgr::GetInstance()->get(d);
+            if (!ctx || ctx->isClose() || !ctx->isSocket())
+            {
+                return ioctl_f(d, request, arg);
+            }
+            ctx->setUserNonblock(user_nonblock);
+        }
+        return ioctl_f(d, request, arg);
+    }
+
+    int getsockopt(int sockfd, int level, int optname, void *optval, socklen_t *optlen)
+    {
+        return getsockopt_f(sockfd, level, optname, optval, optlen);
+    }
+
+    int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen)
+    {
+        if (!event::t_hook_enable)
+        {
+            return setsockopt_f(sockfd, level, optname, optval, optlen);
+        }
+        if (level == SOL_SOCKET)
+        {
+            if (optname == SO_RCVTIMEO || optname == SO_SNDTIMEO)
+            {
+                // 记录超时时间，由do_io的条件定时器实现超时语义
+                event::FdCtx::ptr ctx = event::FdMgr::GetInstance()->get(sockfd);
+                if (ctx)
+                {
+                    const timeval *v = (const timeval *)optval;
+                    ctx->setTimeout(optname, v->tv_sec * 1000 + v->tv_usec / 1000);
+                }
+            }
+        }
+        return setsockopt_f(sockfd, level, optname, optval, optlen);
+    }
+}
@@ -0,0 +1,125 @@
+/**
+ * @file hook.h
+ * @brief 协程化的系统调用hook
+ * @details 拦截阻塞型的socket/sleep系统调用，在调度线程内把"阻塞等待"
+ * 转换成 IOManager::addEvent + yield，事件就绪或超时后再resume当前协程，
+ * 让同步风格的代码以非阻塞epoll的方式运行。hook是线程粒度的开关，
+ * 非调度线程以及未开启hook的线程直接透传原始系统调用
+ * @version 0.1
+ * @date 2024-06-02
+ */
+
+#ifndef __EVENT_HOOK_H__
+#define __EVENT_HOOK_H__
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace event
+{
+
+    /**
+     * @brief 当前线程是否开启hook
+     */
+    bool is_hook_enable();
+
+    /**
+     * @brief 设置当前线程的hook开关
+     * @details 调度线程在Scheduler::run入口开启，其他线程默认关闭
+     */
+    void set_hook_enable(bool flag);
+
+} // namespace event
+
+extern "C"
+{
+
+    /// 以下为被hook的系统调用的原始函数指针，xxx_f由dlsym(RTLD_NEXT)初始化
+
+    // sleep相关
+    typedef unsigned int (*sleep_fun)(unsigned int seconds);
+    extern sleep_fun sleep_f;
+
+    typedef int (*usleep_fun)(useconds_t usec);
+    extern usleep_fun usleep_f;
+
+    typedef int (*nanosleep_fun)(const struct timespec *req, struct timespec *rem);
+    extern nanosleep_fun nanosleep_f;
+
+    // socket相关
+    typedef int (*socket_fun)(int domain, int type, int protocol);
+    extern socket_fun socket_f;
+
+    typedef int (*connect_fun)(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
+    extern connect_fun connect_f;
+
+    typedef int (*accept_fun)(int s, struct sockaddr *addr, socklen_t *addrlen);
+    extern accept_fun accept_f;
+
+    // 读相关
+    typedef ssize_t (*read_fun)(int fd, void *buf, size_t count);
+    extern read_fun read_f;
+
+    typedef ssize_t (*recv_fun)(int sockfd, void *buf, size_t len, int flags);
+    extern recv_fun recv_f;
+
+    typedef ssize_t (*recvfrom_fun)(int sockfd, void *buf, size_t len, int flags,
+                                    struct sockaddr *src_addr, socklen_t *addrlen);
+    extern recvfrom_fun recvfrom_f;
+
+    typedef ssize_t (*recvmsg_fun)(int sockfd, struct msghdr *msg, int flags);
+    extern recvmsg_fun recvmsg_f;
+
+    typedef ssize_t (*readv_fun)(int fd, const struct iovec *iov, int iovcnt);
+    extern readv_fun readv_f;
+
+    // 写相关
+    typedef ssize_t (*write_fun)(int fd, const void *buf, size_t count);
+    extern write_fun write_f;
+
+    typedef ssize_t (*send_fun)(int s, const void *msg, size_t len, int flags);
+    extern send_fun send_f;
+
+    typedef ssize_t (*sendto_fun)(int s, const void *msg, size_t len, int flags,
+                                  const struct sockaddr *to, socklen_t tolen);
+    extern sendto_fun sendto_f;
+
+    typedef ssize_t (*sendmsg_fun)(int s, const struct msghdr *msg, int flags);
+    extern sendmsg_fun sendmsg_f;
+
+    typedef ssize_t (*writev_fun)(int fd, const struct iovec *iov, int iovcnt);
+    extern writev_fun writev_f;
+
+    // fd相关
+    typedef int (*close_fun)(int fd);
+    extern close_fun close_f;
+
+    typedef int (*fcntl_fun)(int fd, int cmd, ... /* arg */);
+    extern fcntl_fun fcntl_f;
+
+    typedef int (*ioctl_fun)(int d, unsigned long int request, ...);
+    extern ioctl_fun ioctl_f;
+
+    typedef int (*getsockopt_fun)(int sockfd, int level, int optname,
+                                  void *optval, socklen_t *optlen);
+    extern getsockopt_fun getsockopt_f;
+
+    typedef int (*setsockopt_fun)(int sockfd, int level, int optname,
+                                  const void *optval, socklen_t optlen);
+    extern setsockopt_fun setsockopt_f;
+
+    /**
+     * @brief 带超时的connect
+     * @param[in] timeout_ms 超时时间(毫秒)，-1表示使用tcp.connect.timeout配置
+     */
+    extern int connect_with_timeout(int fd, const struct sockaddr *addr, socklen_t addrlen,
+                                    uint64_t timeout_ms);
+}
+
+#endif
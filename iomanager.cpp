@@ -5,9 +5,12 @@
  * @date 2024-03-26
  */
 
-#include <unistd.h>    // for pipe()
-#include <sys/epoll.h> // for epoll_xxx()
-#include <fcntl.h>     // for fcntl()
+#include <unistd.h>      // for read()/write()
+#include <sys/epoll.h>   // for epoll_xxx()
+#include <sys/eventfd.h> // for eventfd()
+#include <fcntl.h>       // for fcntl()
+#include <arpa/inet.h>   // for inet_pton()
+#include <netinet/in.h>  // for sockaddr_in
 #include "iomanager.h"
 #include "log.h"
 #include "macro.h"
@@ -112,27 +115,63 @@ namespace event
         return;
     }
 
-    IOManager::IOManager(size_t threads, bool use_caller, const std::string &name)
+    void IOManager::FdContext::triggerEvent(IOManager::Event event, std::vector<ScheduleTask> &batch)
+    {
+        // 待触发的事件必须已被注册过
+        EVENT_ASSERT(events & event);
+        // 持久事件不清注册状态，每次就绪都重新调度一份回调
+        if (persistEvents & event)
+        {
+            EventContext &ctx = getEventContext(event);
+            EVENT_ASSERT(ctx.cb);
+            batch.push_back(ScheduleTask(ctx.cb, -1));
+            return;
+        }
+        events = (Event)(events & ~event);
+        // 不直接调度，攒进batch，由调用方一次性提交
+        EventContext &ctx = getEventContext(event);
+        if (ctx.cb)
+        {
+            batch.push_back(ScheduleTask(std::move(ctx.cb), -1));
+        }
+        else
+        {
+            batch.push_back(ScheduleTask(std::move(ctx.cor), -1));
+        }
+        resetEventContext(ctx);
+    }
+
+    IOManager::IOManager(size_t threads, bool use_caller, const std::string &name, size_t io_shards)
         : Scheduler(threads, use_caller, name)
     {
-        m_epfd = epoll_create(5000); // 最多监听数目
-        EVENT_ASSERT(m_epfd > 0);
+        EVENT_ASSERT(io_shards > 0);
+        // 分片数不应超过idle线程数，多出来的分片没有线程去epoll_wait
+        EVENT_ASSERT(io_shards <= threads + (use_caller ? 1 : 0));
+
+        m_shards.resize(io_shards);
+        for (size_t i = 0; i < io_shards; i++)
+        {
+            Shard::ptr shard(new Shard);
+            shard->epfd = epoll_create(5000); // 最多监听数目
+            EVENT_ASSERT(shard->epfd > 0);
 
-        int rt = pipe(m_tickleFds); // 创建管道，传入int m_tickleFds[2]
-        EVENT_ASSERT(!rt);
+            // 创建eventfd用于tickle，非阻塞配合边缘触发，多次tickle在内核侧合并成一次计数
+            shard->tickleFd = eventfd(0, EFD_NONBLOCK);
+            EVENT_ASSERT(shard->tickleFd >= 0);
 
-        // 关注pipe读句柄的可读事件，用于tickle协程
-        epoll_event event;
-        memset(&event, 0, sizeof(epoll_event));
-        event.events = EPOLLIN | EPOLLET;
-        event.data.fd = m_tickleFds[0];
+            // 关注eventfd的可读事件，用于tickle协程
+            epoll_event event;
+            memset(&event, 0, sizeof(epoll_event));
+            event.events = EPOLLIN | EPOLLET;
+            event.data.fd = shard->tickleFd;
 
-        // 非阻塞方式，配合边缘触发
-        rt = fcntl(m_tickleFds[0], F_SETFL, O_NONBLOCK);
-        EVENT_ASSERT(!rt);
-        // 第二个参数表示对epoll监控描述符控制的动作，在此EPOLL_CTL_ADD 表注册新的fd到epfd，
-        // m_tickleFds[0]:需要监听的文件描述符，event：告诉内核需要监听的事件
-        rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &event);
+            // 第二个参数表示对epoll监控描述符控制的动作，在此EPOLL_CTL_ADD 表注册新的fd到epfd，
+            // tickleFd:需要监听的文件描述符，event：告诉内核需要监听的事件
+            int rt = epoll_ctl(shard->epfd, EPOLL_CTL_ADD, shard->tickleFd, &event);
+            EVENT_ASSERT(!rt);
+
+            m_shards[i] = shard;
+        }
 
         contextResize(32);
 
@@ -142,50 +181,96 @@ namespace event
     IOManager::~IOManager()
     {
         stop();
-        close(m_epfd);
-        close(m_tickleFds[0]);
-        close(m_tickleFds[1]);
+        for (auto &shard : m_shards)
+        {
+            close(shard->epfd);
+            close(shard->tickleFd);
+        }
 
-        for (size_t i = 0; i < m_fdContexts.size(); ++i)
+        // 此时调度已停止，没有并发读者，FdContext和新旧表都可以安全释放
+        FdContextTable *table = m_fdTable.load(std::memory_order_relaxed);
+        if (table)
         {
-            if (m_fdContexts[i])
-            {
-                delete m_fdContexts[i];
-            }
+            delete[] table->slots;
+            delete table;
+        }
+        for (auto slab : m_fdSlabs)
+        {
+            delete[] slab;
+        }
+        for (auto retired : m_retiredTables)
+        {
+            delete[] retired->slots;
+            delete retired;
         }
     }
 
     void IOManager::contextResize(size_t size)
     {
-        m_fdContexts.resize(size);
+        FdContextTable *old_table = m_fdTable.load(std::memory_order_relaxed);
+        if (old_table && old_table->size >= size)
+        {
+            // 其他线程抢先完成了扩容
+            return;
+        }
 
-        for (size_t i = 0; i < m_fdContexts.size(); ++i)
+        // 新表复制旧表的FdContext指针，新增槽位补齐FdContext
+        FdContextTable *table = new FdContextTable;
+        table->size = size;
+        table->slots = new FdContext *[size];
+        size_t old_size = old_table ? old_table->size : 0;
+        for (size_t i = 0; i < old_size; ++i)
         {
-            if (!m_fdContexts[i])
-            {
-                m_fdContexts[i] = new FdContext;
-                m_fdContexts[i]->fd = i;
-            }
+            table->slots[i] = old_table->slots[i];
+        }
+        // 新增的FdContext从一块连续内存上分，不逐个new，
+        // 相邻fd的上下文内存上也相邻，块归m_fdSlabs所有
+        FdContext *slab = new FdContext[size - old_size];
+        m_fdSlabs.push_back(slab);
+        for (size_t i = old_size; i < size; ++i)
+        {
+            table->slots[i] = &slab[i - old_size];
+            table->slots[i]->fd = i;
+        }
+
+        // 原子发布新表，旧表退役，可能还有读者在用，析构时再释放
+        m_fdTable.store(table, std::memory_order_release);
+        if (old_table)
+        {
+            m_retiredTables.push_back(old_table);
         }
     }
 
-    int IOManager::addEvent(int fd, Event event, std::function<void()> cb)
+    IOManager::FdContext *IOManager::getFdContext(int fd, bool auto_create)
     {
-        // 找到fd对应的FdContext，如果不存在，那就分配一个
-        FdContext *fd_ctx = nullptr;
-        RWMutexType::ReadLock lock(m_mutex);
-        if ((int)m_fdContexts.size() > fd)
+        if (fd < 0)
         {
-            fd_ctx = m_fdContexts[fd];
-            lock.unlock();
+            return nullptr;
         }
-        else
+        // 读路径wait-free：加载表指针后直接下标访问
+        FdContextTable *table = m_fdTable.load(std::memory_order_acquire);
+        if (table && fd < (int)table->size)
         {
-            lock.unlock();
-            RWMutexType::WriteLock lock2(m_mutex);
-            contextResize(fd * 1.5);
-            fd_ctx = m_fdContexts[fd];
+            return table->slots[fd];
         }
+        if (!auto_create)
+        {
+            return nullptr;
+        }
+
+        RWMutexType::WriteLock lock(m_mutex);
+        contextResize(fd * 1.5);
+        return m_fdTable.load(std::memory_order_relaxed)->slots[fd];
+    }
+
+    int IOManager::addEvent(int fd, Event event, std::function<void()> cb, bool persistent,
+                            bool exclusive)
+    {
+        // 持久注册必须提供回调函数，协程做执行体只能消费一次就绪
+        EVENT_ASSERT(!persistent || cb);
+
+        // 找到fd对应的FdContext，如果不存在，那就分配一个
+        FdContext *fd_ctx = getFdContext(fd, true);
 
         // 同一个fd不允许重复添加相同的事件
         FdContext::MutexType::Lock lock2(fd_ctx->mutex);
@@ -198,16 +283,24 @@ namespace event
         }
 
         // 将新的事件加入epoll_wait，使用epoll_event的私有指针存储FdContext的位置
+        // fd按归属分片注册，事件只会在该分片的epoll实例上就绪
+        int epfd = shardFor(fd)->epfd;
         int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        // EPOLLEXCLUSIVE只在首次注册(EPOLL_CTL_ADD)时有效，内核不允许MOD
+        EVENT_ASSERT(!exclusive || op == EPOLL_CTL_ADD);
         epoll_event epevent;
         epevent.events = EPOLLET | fd_ctx->events | event;
+        if (exclusive)
+        {
+            epevent.events |= EPOLLEXCLUSIVE;
+        }
         epevent.data.ptr = fd_ctx;
         // op: 如果已添加该事件，动作：修改已经注册的fd的监听事件；
         // 如果还没添加该事件，动作：注册新的fd到epfd
-        int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+        int rt = epoll_ctl(epfd, op, fd, &epevent);
         if (rt)
         {
-            SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+            SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
                                       << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
                                       << rt << " (" << errno << ") (" << strerror(errno) << ") fd_ctx->events="
                                       << (EPOLL_EVENTS)fd_ctx->events;
@@ -219,6 +312,10 @@ namespace event
 
         // 找到这个fd的event事件对应的EventContext，对其中的scheduler, cb, cor进行赋值
         fd_ctx->events = (Event)(fd_ctx->events | event);
+        if (persistent)
+        {
+            fd_ctx->persistEvents = (Event)(fd_ctx->persistEvents | event);
+        }
         FdContext::EventContext &event_ctx = fd_ctx->getEventContext(event);
         EVENT_ASSERT(!event_ctx.scheduler && !event_ctx.cor && !event_ctx.cb);
 
@@ -236,16 +333,73 @@ namespace event
         return 0;
     }
 
+    int IOManager::addListener(int fd, std::function<void()> cb)
+    {
+        // 持久注册免掉每次就绪后的epoll_ctl重挂，独占注册避免惊群
+        return addEvent(fd, READ, cb, true, true);
+    }
+
+    std::vector<int> IOManager::CreateReusePortListeners(const std::string &host, uint16_t port,
+                                                         size_t count, int backlog)
+    {
+        std::vector<int> fds;
+        fds.reserve(count);
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+        {
+            EVENT_LOG_ERROR(g_logger) << "CreateReusePortListeners invalid host=" << host;
+            return fds;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (fd < 0)
+            {
+                EVENT_LOG_ERROR(g_logger) << "CreateReusePortListeners socket error"
+                                          << " (" << errno << ") (" << strerror(errno) << ")";
+                break;
+            }
+            int opt = 1;
+            // SO_REUSEPORT让N个socket绑到同一地址，内核按四元组哈希分摊新连接
+            if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+                setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) ||
+                bind(fd, (sockaddr *)&addr, sizeof(addr)) ||
+                listen(fd, backlog))
+            {
+                EVENT_LOG_ERROR(g_logger) << "CreateReusePortListeners bind/listen "
+                                          << host << ":" << port << " error"
+                                          << " (" << errno << ") (" << strerror(errno) << ")";
+                close(fd);
+                break;
+            }
+            fds.push_back(fd);
+        }
+
+        // 要么整组可用，要么一个不留，调用方不必处理半成品
+        if (fds.size() != count)
+        {
+            for (auto fd : fds)
+            {
+                close(fd);
+            }
+            fds.clear();
+        }
+        return fds;
+    }
+
     bool IOManager::delEvent(int fd, Event event)
     {
         // 找到fd对应的FdContext
-        RWMutexType::ReadLock lock(m_mutex);
-        if ((int)m_fdContexts.size() <= fd)
+        FdContext *fd_ctx = getFdContext(fd, false);
+        if (!fd_ctx)
         { // 不存在该fd
             return false;
         }
-        FdContext *fd_ctx = m_fdContexts[fd];
-        lock.unlock();
 
         FdContext::MutexType::Lock lock2(fd_ctx->mutex);
         if (EVENT_UNLIKELY(!(fd_ctx->events & event)))
@@ -254,15 +408,16 @@ namespace event
         }
 
         // 清除指定的事件，表示不关心这个事件了，如果清除之后结果为0，则从epoll_wait中删除该文件描述符
+        int epfd = shardFor(fd)->epfd;
         Event new_events = (Event)(fd_ctx->events & ~event);
         int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
         epoll_event epevent;
         epevent.events = EPOLLET | new_events; // 边缘触发
         epevent.data.ptr = fd_ctx;
 
-        int rt = epoll_ctl(m_epfd, op, fd, &epevent);
+        int rt = epoll_ctl(epfd, op, fd, &epevent);
         if (rt) {
-            EVENT_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+            EVENT_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
                                     << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
                                     << rt << " (" << errno << ") (" << strerror(errno) << ")";
             return false;
@@ -272,8 +427,335 @@ namespace event
         --m_pendingEventCount;
         // 重置该fd对应的event事件上下文
         fd_ctx->events = new_events;
+        fd_ctx->persistEvents = (Event)(fd_ctx->persistEvents & ~event);
         FdContext::EventContext &event_ctx = fd_ctx->getEventContext(event);
         fd_ctx->resetEventContext(event_ctx);
         return true;
+    }
+
+    bool IOManager::cancelEvent(int fd, Event event)
+    {
+        // 找到fd对应的FdContext
+        FdContext *fd_ctx = getFdContext(fd, false);
+        if (!fd_ctx)
+        {
+            return false;
         }
+
+        FdContext::MutexType::Lock lock2(fd_ctx->mutex);
+        if (EVENT_UNLIKELY(!(fd_ctx->events & event)))
+        {
+            return false;
+        }
+
+        // 与delEvent一样先从epoll上摘除，区别是cancel在摘除前触发一次回调
+        int epfd = shardFor(fd)->epfd;
+        Event new_events = (Event)(fd_ctx->events & ~event);
+        int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        epoll_event epevent;
+        epevent.events = EPOLLET | new_events;
+        epevent.data.ptr = fd_ctx;
+
+        int rt = epoll_ctl(epfd, op, fd, &epevent);
+        if (rt)
+        {
+            EVENT_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
+                                      << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
+                                      << rt << " (" << errno << ") (" << strerror(errno) << ")";
+            return false;
+        }
+
+        // 先去掉持久标记，让triggerEvent走一次性路径完成清理
+        fd_ctx->persistEvents = (Event)(fd_ctx->persistEvents & ~event);
+        // 删除之前触发一次事件
+        fd_ctx->triggerEvent(event);
+        // 待执行事件数减1
+        --m_pendingEventCount;
+        return true;
+    }
+
+    bool IOManager::cancelAll(int fd)
+    {
+        // 找到fd对应的FdContext
+        FdContext *fd_ctx = getFdContext(fd, false);
+        if (!fd_ctx)
+        {
+            return false;
+        }
+
+        FdContext::MutexType::Lock lock2(fd_ctx->mutex);
+        if (!fd_ctx->events)
+        {
+            return false;
+        }
+
+        // 从epoll上摘除全部事件
+        int epfd = shardFor(fd)->epfd;
+        int op = EPOLL_CTL_DEL;
+        epoll_event epevent;
+        epevent.events = 0;
+        epevent.data.ptr = fd_ctx;
+
+        int rt = epoll_ctl(epfd, op, fd, &epevent);
+        if (rt)
+        {
+            EVENT_LOG_ERROR(g_logger) << "epoll_ctl(" << epfd << ", "
+                                      << (EpollCtlOp)op << ", " << fd << ", " << (EPOLL_EVENTS)epevent.events << "):"
+                                      << rt << " (" << errno << ") (" << strerror(errno) << ")";
+            return false;
+        }
+
+        // 触发全部已注册的事件
+        fd_ctx->persistEvents = NONE;
+        if (fd_ctx->events & READ)
+        {
+            fd_ctx->triggerEvent(READ);
+            --m_pendingEventCount;
+        }
+        if (fd_ctx->events & WRITE)
+        {
+            fd_ctx->triggerEvent(WRITE);
+            --m_pendingEventCount;
+        }
+
+        EVENT_ASSERT(fd_ctx->events == 0);
+        return true;
+    }
+
+    IOManager *IOManager::GetThis()
+    {
+        return dynamic_cast<IOManager *>(Scheduler::GetThis());
+    }
+
+    void IOManager::tickleShard(Shard *shard)
+    {
+        // 已经有一次在途的唤醒，idle协程醒来后自会看到新任务，不重复写
+        if (shard->tickled.exchange(true, std::memory_order_acq_rel))
+        {
+            return;
+        }
+        uint64_t one = 1;
+        int rt = write(shard->tickleFd, &one, sizeof(one));
+        EVENT_ASSERT(rt == sizeof(one));
+        PerfCounters::Inc(PerfCounters::TICKLE_WRITES);
+    }
+
+    void IOManager::tickle()
+    {
+        // 没有线程阻塞在epoll_wait上就不必唤醒
+        if (!hasIdleThreads())
+        {
+            return;
+        }
+        // 挑一个真正停在epoll_wait里的分片唤醒，一个新任务只需要一个线程来接；
+        // 从轮转位置开始找，避免总是打醒同一个分片。盲目轮转会把唤醒写给
+        // 正在干活的分片，停着的那个要等满epoll超时才看到任务
+        size_t start = m_tickleSeq++;
+        for (size_t i = 0; i < m_shards.size(); i++)
+        {
+            Shard *shard = m_shards[(start + i) % m_shards.size()].get();
+            if (shard->parked.load(std::memory_order_acquire))
+            {
+                tickleShard(shard);
+                return;
+            }
+        }
+        // 没有分片标记为停靠（都处在停靠前后的窗口里），全部唤醒兜底，
+        // 多出来的只是空唤醒
+        for (auto &shard : m_shards)
+        {
+            tickleShard(shard.get());
+        }
+    }
+
+    bool IOManager::stopping(uint64_t &timeout)
+    {
+        // 对于IOManager而言，必须等所有待调度的IO事件和定时器都执行完了才可以退出
+        timeout = getNextTimer();
+        return timeout == ~0ull && m_pendingEventCount == 0 && Scheduler::stopping();
+    }
+
+    bool IOManager::stopping()
+    {
+        uint64_t timeout = 0;
+        return stopping(timeout);
+    }
+
+    void IOManager::idle()
+    {
+        EVENT_LOG_DEBUG(g_logger) << "idle";
+
+        // 领取本线程独占的epoll分片，线程只epoll_wait自己分片上的fd
+        Shard *shard = m_shards[m_shardAlloc++ % m_shards.size()].get();
+
+        // 一次epoll_wait最多检测256个就绪事件，如果就绪事件超过了这个数，那么会在下轮epoll_wait继续处理
+        const uint64_t MAX_EVENTS = 256;
+        epoll_event *events = new epoll_event[MAX_EVENTS]();
+        std::shared_ptr<epoll_event> shared_events(events, [](epoll_event *ptr)
+                                                   { delete[] ptr; });
+
+        while (true)
+        {
+            // 获取下一个定时器的超时时间，顺便判断调度器是否停止
+            uint64_t next_timeout = 0;
+            if (EVENT_UNLIKELY(stopping(next_timeout)))
+            {
+                EVENT_LOG_DEBUG(g_logger) << "name=" << getName() << " idle stopping exit";
+                break;
+            }
+
+            // 阻塞在epoll_wait上，超时时间取最近一个定时器的到期时间，等待事件发生或定时器到期
+            int rt = 0;
+            do
+            {
+                // 默认超时时间5秒，如果下一个定时器的超时时间大于5秒，仍以5秒来计算超时，避免定时器超时时间太大时，epoll_wait一直阻塞
+                static const int MAX_TIMEOUT = 5000;
+                if (next_timeout != ~0ull)
+                {
+                    next_timeout = std::min(next_timeout, (uint64_t)MAX_TIMEOUT);
+                }
+                else
+                {
+                    next_timeout = MAX_TIMEOUT;
+                }
+                // 标记本分片停靠中，tickle只会把唤醒送给停着的分片
+                shard->parked.store(true, std::memory_order_release);
+                rt = epoll_wait(shard->epfd, events, MAX_EVENTS, (int)next_timeout);
+                shard->parked.store(false, std::memory_order_release);
+                if (rt < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                else
+                {
+                    break;
+                }
+            } while (true);
+
+            PerfCounters::Inc(PerfCounters::EPOLL_WAKEUPS);
+
+            // 收集所有已超时的定时器，一次加锁批量调度其回调函数
+            std::vector<std::function<void()>> cbs;
+            listExpiredCb(cbs);
+            if (!cbs.empty())
+            {
+                schedule(cbs.begin(), cbs.end());
+                cbs.clear();
+            }
+
+            // 本轮就绪事件产生的任务先攒起来，循环结束后整批提交
+            // epoll_wait非EINTR出错时rt为-1，不能直接喂给reserve
+            std::vector<ScheduleTask> batch;
+            batch.reserve(rt > 0 ? rt : 0);
+
+            // 遍历所有发生的事件，根据epoll_event的私有指针找到对应的FdContext，进行事件处理
+            for (int i = 0; i < rt; ++i)
+            {
+                epoll_event &event = events[i];
+                if (event.data.fd == shard->tickleFd)
+                {
+                    // tickle fd，只用于唤醒epoll_wait
+                    // 先读计数再清标志：反过来的话，落在清标志和读计数之间的
+                    // tickle（置位+写入）会被这次drain吃掉写入却留下置位的标志，
+                    // 之后的tickle被永久跳过。现在的顺序下竞争窗口里的tickle
+                    // 至多少写一次（本线程已醒，重新停靠前必然再查一遍队列）
+                    // 或者多一次空唤醒，都无害
+                    uint64_t dummy = 0;
+                    while (read(shard->tickleFd, &dummy, sizeof(dummy)) > 0)
+                        ;
+                    shard->tickled.store(false, std::memory_order_release);
+                    continue;
+                }
+
+                FdContext *fd_ctx = (FdContext *)event.data.ptr;
+                FdContext::MutexType::Lock lock(fd_ctx->mutex);
+                /**
+                 * EPOLLERR: 出错，比如写读端已经关闭的pipe
+                 * EPOLLHUP: 套接字对端关闭
+                 * 出现这两种事件，应该同时触发fd的读和写事件，否则有可能出现注册的事件永远执行不到的情况
+                 */
+                if (event.events & (EPOLLERR | EPOLLHUP))
+                {
+                    event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
+                }
+                int real_events = NONE;
+                if (event.events & EPOLLIN)
+                {
+                    real_events |= READ;
+                }
+                if (event.events & EPOLLOUT)
+                {
+                    real_events |= WRITE;
+                }
+
+                if ((fd_ctx->events & real_events) == NONE)
+                {
+                    continue;
+                }
+
+                // 剔除已经发生的一次性事件，持久事件继续挂在epoll上边缘触发
+                // 只有注册集合真的变化了才需要epoll_ctl，全是持久事件时一次系统调用都不用
+                int oneshot_events = real_events & ~fd_ctx->persistEvents;
+                if (oneshot_events)
+                {
+                    int left_events = (fd_ctx->events & ~oneshot_events);
+                    int op = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+                    event.events = EPOLLET | left_events;
+
+                    int rt2 = epoll_ctl(shard->epfd, op, fd_ctx->fd, &event);
+                    if (rt2)
+                    {
+                        EVENT_LOG_ERROR(g_logger) << "epoll_ctl(" << shard->epfd << ", "
+                                                  << (EpollCtlOp)op << ", " << fd_ctx->fd << ", " << (EPOLL_EVENTS)event.events << "):"
+                                                  << rt2 << " (" << errno << ") (" << strerror(errno) << ")";
+                        continue;
+                    }
+                }
+
+                // 摘出已经发生的事件对应的任务，攒进batch
+                // 持久事件的待执行计数在addEvent时记过一次，这里不减
+                if (real_events & READ)
+                {
+                    fd_ctx->triggerEvent(READ, batch);
+                    if (oneshot_events & READ)
+                    {
+                        --m_pendingEventCount;
+                    }
+                }
+                if (real_events & WRITE)
+                {
+                    fd_ctx->triggerEvent(WRITE, batch);
+                    if (oneshot_events & WRITE)
+                    {
+                        --m_pendingEventCount;
+                    }
+                }
+            }
+
+            // 一次加锁提交本轮的全部就绪任务，最多tickle一次
+            if (!batch.empty())
+            {
+                PerfCounters::Inc(PerfCounters::EVENTS_DISPATCHED, batch.size());
+                scheduleTasks(batch);
+            }
+
+            /**
+             * 一旦处理完所有的事件，idle协程yield，这样可以让调度协程(Scheduler::run)重新检查是否有新任务要调度
+             * 上面triggerEvent实际也只是把对应的cor重新加入调度，要执行的话还要等idle协程退出
+             */
+            Cor::ptr cur = Cor::GetThis();
+            auto raw_ptr = cur.get();
+            cur.reset();
+            raw_ptr->yield();
+        }
+    }
+
+    void IOManager::onTimerInsertedAtFront()
+    {
+        // 最近的定时器提前了，每个分片上阻塞的epoll_wait超时都可能过长，逐个唤醒
+        for (auto &shard : m_shards)
+        {
+            tickleShard(shard.get());
+        }
+    }
 }
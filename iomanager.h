@@ -8,14 +8,16 @@
 #ifndef __EVENT_IOMANAGER_H__
 #define __EVENT_IOMANAGER_H__
 
+#include <sys/socket.h>
 #include "scheduler.h"
+#include "timer.h"
 
 namespace event
 {
 
     static event::Logger::ptr g_logger = EVENT_LOG_NAME("system");
 
-    class IOManager : public Scheduler
+    class IOManager : public Scheduler, public TimerManager
     {
     public:
         typedef std::shared_ptr<IOManager> ptr;
@@ -78,16 +80,32 @@ namespace event
              */
             void triggerEvent(Event event);
 
-            /// 读事件上下文
-            EventContext read;
-            /// 写事件上下文
-            EventContext write;
+            /**
+             * @brief 触发事件，但不立即调度，把任务收集到batch中
+             * @details 供idle协程把一轮epoll_wait的全部就绪事件攒成一批，
+             * 再通过Scheduler::scheduleTasks一次性提交
+             * @param[in] event 事件类型
+             * @param[out] batch 收集就绪任务的数组
+             */
+            void triggerEvent(Event event, std::vector<ScheduleTask> &batch);
+
+            /// 热区：事件分发和注册路径每次都要碰的字段，凑在同一缓存行
             /// 事件关联的句柄
             int fd = 0;
             /// 该fd添加了哪些事件的回调函数，或者说该fd关心哪些事件
             Event events = NONE;
+            /// 持久注册的事件集合，就绪时不从epoll上摘除，也不清回调，
+            /// 每次边缘触发都重新调度一份回调，直到delEvent/cancelEvent
+            Event persistEvents = NONE;
             /// 事件的Mutex
             MutexType mutex;
+
+            /// 冷区：回调存储，注册时写一次、触发时读一次，从下一个
+            /// 缓存行开始，写回调不会把其他核上的热区缓存行打失效
+            /// 读事件上下文
+            alignas(64) EventContext read;
+            /// 写事件上下文
+            EventContext write;
         };
 
     public:
@@ -96,8 +114,14 @@ namespace event
          * @param[in] threads 线程数量
          * @param[in] use_caller 是否将调用线程包含进去
          * @param[in] name 调度器的名称
+         * @param[in] io_shards epoll实例的分片数。单个epoll实例在高连接数
+         * 下就绪链表的处理会成为瓶颈，分片后fd按取模固定归属一个分片，
+         * 每个分片由一个idle线程独占地epoll_wait，tickle也只唤醒一个分片。
+         * 专职IO线程模式建议use_caller取false且io_shards等于threads，
+         * 每个工作线程独占一个epoll实例
          */
-        IOManager(size_t threads = 1, bool use_caller = true, const std::string &name = "IOManager");
+        IOManager(size_t threads = 1, bool use_caller = true, const std::string &name = "IOManager",
+                  size_t io_shards = 1);
 
         /**
          * @brief 析构函数
@@ -110,9 +134,50 @@ namespace event
          * @param[in] fd socket句柄
          * @param[in] event 事件类型
          * @param[in] cb 事件回调函数，如果为空，则默认把当前协程作为回调执行体
+         * @param[in] persistent 是否持久注册。一次性注册每次就绪都要一次
+         * epoll_ctl摘除、下次关注再一次epoll_ctl加回，长连接上epoll_ctl会成为
+         * 仅次于epoll_wait的系统调用开销。持久注册让fd一直以边缘触发挂在
+         * epoll上，每次就绪只是重新调度一份回调，完全不碰epoll_ctl，
+         * 直到delEvent/cancelEvent才摘除。持久注册必须提供cb，
+         * 协程做回调执行体只能消费一次就绪
+         * @param[in] exclusive 是否以EPOLLEXCLUSIVE注册。多个线程epoll_wait
+         * 同一个epoll实例时，普通注册的fd一次就绪会唤醒所有等待线程（惊群），
+         * 只有一个能抢到数据；独占注册让内核每次就绪只唤醒一个等待者。
+         * 监听fd的accept场景专用。EPOLLEXCLUSIVE只能在首次注册时指定，
+         * 该fd上不能再追加其他事件
+         * @attention 持久事件计入待执行事件数，调度器停止前必须显式取消
+         * @return 添加成功返回0,失败返回-1
+         */
+        int addEvent(int fd, Event event, std::function<void()> cb = nullptr, bool persistent = false,
+                     bool exclusive = false);
+
+        /**
+         * @brief 注册一个监听fd，cb为accept处理函数
+         * @details 等价于addEvent(fd, READ, cb, persistent=true, exclusive=true)：
+         * 持久注册省掉每次就绪后的epoll_ctl重挂，EPOLLEXCLUSIVE避免连接
+         * 突发时惊群唤醒整组idle线程。回调在每次监听fd可读时被调度，
+         * 回调内应循环accept直到EAGAIN（边缘触发）
+         * @param[in] fd 监听fd
+         * @param[in] cb accept处理函数
          * @return 添加成功返回0,失败返回-1
          */
-        int addEvent(int fd, Event event, std::function<void()> cb = nullptr);
+        int addListener(int fd, std::function<void()> cb);
+
+        /**
+         * @brief 创建N个绑定同一地址的SO_REUSEPORT监听socket
+         * @details 单个监听socket是接入吞吐的上限：所有accept都在一个fd的
+         * 全连接队列上竞争。SO_REUSEPORT让内核按四元组哈希把新连接分摊到
+         * N个socket各自的队列里，每个socket交给一个工作线程accept，
+         * 线程之间不共享FdContext也不共享队列锁。通常N取工作线程数，
+         * 每个返回的fd用addListener注册
+         * @param[in] host 监听地址，IPv4点分十进制
+         * @param[in] port 监听端口
+         * @param[in] count socket个数
+         * @param[in] backlog listen的全连接队列长度
+         * @return 创建好的监听fd数组，失败时返回空数组并关闭已创建的fd
+         */
+        static std::vector<int> CreateReusePortListeners(const std::string &host, uint16_t port,
+                                                         size_t count, int backlog = SOMAXCONN);
 
         /**
          * @brief 删除事件
@@ -148,7 +213,8 @@ namespace event
     protected:
         /**
          * @brief 通知调度器有任务要调度
-         * @details 写pipe让idle协程从epoll_wait退出，待idle协程yield之后Scheduler::run就可以调度其他任务
+         * @details 写eventfd让idle协程从epoll_wait退出，待idle协程yield之后Scheduler::run就可以调度其他任务
+         * 没有线程阻塞在epoll_wait上、或者已经有一次未被消费的唤醒时直接返回，不做多余的写入
          */
         void tickle() override;
 
@@ -158,29 +224,109 @@ namespace event
          */
         bool stopping() override;
 
+        /**
+         * @brief 判断是否可以停止，同时获取最近一个定时器的超时时间
+         * @param[out] timeout 最近一个定时器的超时时间，用于idle协程的epoll_wait
+         * @return 返回是否可以停止
+         */
+        bool stopping(uint64_t &timeout);
+
         /**
          * @brief idle协程
          * @details 对于IO协程调度来说，应阻塞在等待IO事件上，idle退出的时机是epoll_wait返回，对应的操作是tickle或注册的IO事件发生
+         * epoll_wait的超时时间取最近一个定时器的到期时间，返回后先批量调度已到期的定时器回调，再处理就绪的IO事件
          */
         void idle() override;
 
         /**
-         * @brief 重置socket句柄上下文的容器大小
+         * @brief 当有定时器插入到堆顶时，重设epoll_wait的超时时间
+         */
+        void onTimerInsertedAtFront() override;
+
+        /**
+         * @brief 扩容socket句柄上下文表
+         * @details 只能在持有m_mutex写锁时调用，按1.5倍几何扩容，
+         * 构造新表后原子发布，旧表退役到m_retiredTables，析构时统一释放
          * @param[in] size 容量大小
          */
         void contextResize(size_t size);
 
+        /**
+         * @brief 查找fd对应的FdContext
+         * @details 读路径wait-free：一次acquire加载表指针加一次下标访问，
+         * 不取任何锁；只有fd超出当前表大小需要扩容时才走m_mutex写锁
+         * @param[in] fd socket句柄
+         * @param[in] auto_create 表太小时是否扩容创建
+         * @return 对应的FdContext，不存在且不扩容时返回nullptr
+         */
+        FdContext *getFdContext(int fd, bool auto_create);
+
     private:
-        /// epoll 文件句柄
-        int m_epfd = 0;
-        /// pipe 文件句柄，fd[0]读端，fd[1]写端
-        int m_tickleFds[2];
+        /**
+         * @brief epoll分片，一个分片一个epoll实例，由一个idle线程独占
+         */
+        struct Shard
+        {
+            typedef std::shared_ptr<Shard> ptr;
+
+            /// epoll 文件句柄
+            int epfd = -1;
+            /// eventfd 文件句柄，用于tickle唤醒阻塞在本分片epoll_wait上的
+            /// idle协程，内核侧按计数器合并多次写入，只占一个fd
+            int tickleFd = -1;
+            /// 是否已有一次未被消费的tickle，idle协程醒来前重复的tickle直接跳过
+            std::atomic<bool> tickled = {false};
+            /// 本分片的idle线程是否正阻塞在epoll_wait里，
+            /// tickle据此把唤醒送给真正停着的分片
+            std::atomic<bool> parked = {false};
+        };
+
+        /**
+         * @brief fd归属的分片，按取模分配，归属关系在fd生命周期内不变
+         */
+        Shard *shardFor(int fd)
+        {
+            return m_shards[fd % m_shards.size()].get();
+        }
+
+        /**
+         * @brief 唤醒指定分片上阻塞在epoll_wait的idle线程
+         * @details 分片已有一次未被消费的唤醒时直接返回，不重复写
+         */
+        void tickleShard(Shard *shard);
+
+        /// epoll分片数组，至少一个
+        std::vector<Shard::ptr> m_shards;
+        /// 分片分配器，idle线程在入口领取自己独占的分片
+        std::atomic<size_t> m_shardAlloc = {0};
+        /// tickle的轮转计数，把唤醒摊到各个分片上
+        std::atomic<size_t> m_tickleSeq = {0};
         /// 当前等待执行的IO事件数量
         std::atomic<size_t> m_pendingEventCount = {0};
-        /// IOManager的Mutex
+
+        /**
+         * @brief socket事件上下文表，RCU风格
+         * @details 指针数组加大小打包成一个不可变对象，读者原子加载表指针后
+         * 直接下标访问；扩容时构造新表整体替换，FdContext本体指针不变，
+         * 同一个fd在新旧表里指向同一个FdContext
+         */
+        struct FdContextTable
+        {
+            /// FdContext指针数组
+            FdContext **slots = nullptr;
+            /// 数组大小
+            size_t size = 0;
+        };
+
+        /// IOManager的Mutex，只用于串行化扩容，读路径不再加锁
         RWMutexType m_mutex;
-        /// socket事件上下文的容器
-        std::vector<FdContext *> m_fdContexts;
+        /// 当前socket事件上下文表
+        std::atomic<FdContextTable *> m_fdTable = {nullptr};
+        /// 退役的旧表，可能仍被读者持有，析构时统一释放
+        std::vector<FdContextTable *> m_retiredTables;
+        /// FdContext的连续内存块，每次扩容一块，相邻fd的上下文在内存上
+        /// 也相邻，批量分发时预取友好；FdContext归块所有，析构时整块释放
+        std::vector<FdContext *> m_fdSlabs;
     };
 
 }
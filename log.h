@@ -14,12 +14,14 @@
 #include <sstream>
 #include <fstream>
 #include <vector>
+#include <atomic>
 #include <cstdarg>
 #include <list>
 #include <map>
 #include "util.h"
 #include "mutex.h"
 #include "singleton.h"
+#include "thread.h"
 
 /**
  * @brief 获取root日志器
@@ -31,18 +33,30 @@
  */
 #define EVENT_LOG_NAME(name) event::LoggerMgr::GetInstance()->getLogger(name)
 
+/**
+ * @brief 编译期日志级别下限
+ * @details 数值大于该级别的日志语句整条在编译期被消除：level是编译期常量，
+ * 与下限的比较折叠成false后整个if分支连同流式表达式一起被优化掉，
+ * 热路径上连级别判断那一条指令都不留。发布构建可定义为
+ * event::LogLevel::INFO剔除所有DEBUG语句，默认NOTSET保留全部级别
+ */
+#ifndef EVENT_LOG_MIN_LEVEL
+#define EVENT_LOG_MIN_LEVEL event::LogLevel::NOTSET
+#endif
+
 /**
  * @brief 使用流式方式将日志级别level的日志写入到logger
  * @details 构造一个LogEventWrap对象，把日志器和日志事件包装到一起，
- * 在对象析构的时候调用日志器写日志事件
+ * 在对象析构的时候调用日志器写日志事件。级别判断是一次relaxed原子读
+ * 加一个预测不命中的分支，getLevel未通过时不求值任何流式参数
  * @todo 协程id未实现，暂时写0
  */
-#define EVENT_LOG_LEVEL(logger, level)                                                                                                               \
-    if (level <= logger->getLevel())                                                                                                                 \
-    event::LogEventWrap(logger, event::LogEvent::ptr(new event::LogEvent(logger->getName(),                                                          \
-                                                                         level, __FILE__, __LINE__, event::GetElapsed() - logger->getCreateTime(),   \
-                                                                         event::GetThreadId(), event::GetCorId(), time(0), event::GetThreadName()))) \
-        .getLogEvent->getSS()
+#define EVENT_LOG_LEVEL(logger, level)                                                                                                      \
+    if (__builtin_expect((level) <= EVENT_LOG_MIN_LEVEL && (level) <= logger->getLevel(), 0))                                               \
+    event::LogEventWrap(logger, event::LogEvent::Create(logger->getName(),                                                                  \
+                                                        level, __FILE__, __LINE__, event::GetElapsed() - logger->getCreateTime(),           \
+                                                        event::GetThreadId(), event::GetCorId(), time(0), event::GetThreadName()))          \
+        .getLogEvent()->getSS()
 
 #define EVENT_LOG_FATAL(logger) EVENT_LOG_LEVEL(logger, event::LogLevel::FATAL)
 
@@ -66,10 +80,10 @@
  * @todo 协程id未实现，暂时写0
  */
 #define EVENT_LOG_FMT_LEVEL(logger, level, fmt, ...) \
-    if(level <= logger->getLevel()) \
-        event::LogEventWrap(logger, event::LogEvent::ptr(new event::LogEvent(logger->getName(), \
+    if(__builtin_expect((level) <= EVENT_LOG_MIN_LEVEL && (level) <= logger->getLevel(), 0)) \
+        event::LogEventWrap(logger, event::LogEvent::Create(logger->getName(), \
             level, __FILE__, __LINE__, event::GetElapsed() - logger->getCreateTime(), \
-            event::GetThreadId(), event::GetFiberId(), time(0), event::GetThreadName()))).getLogEvent()->printf(fmt, __VA_ARGS__)
+            event::GetThreadId(), event::GetCorId(), time(0), event::GetThreadName())).getLogEvent()->printf(fmt, __VA_ARGS__)
 
 #define EVENT_LOG_FMT_FATAL(logger, fmt, ...) EVENT_LOG_FMT_LEVEL(logger, event::LogLevel::FATAL, fmt, __VA_ARGS__)
 
@@ -87,7 +101,7 @@
 
 #define EVENT_LOG_FMT_DEBUG(logger, fmt, ...) EVENT_LOG_FMT_LEVEL(logger, event::LogLevel::DEBUG, fmt, __VA_ARGS__)
 
-namespace sylar {
+namespace event {
 
 /**
  * @brief 日志级别
@@ -148,7 +162,51 @@ public:
      */
     LogEvent(const std::string &logger_name, LogLevel::Level level, const char *file, int32_t line
         , int64_t elapse, uint32_t thread_id, uint64_t fiber_id, time_t time, const std::string &thread_name);
-    
+
+    /**
+     * @brief 从线程本地对象池获取一个日志事件，参数同构造函数
+     * @details 每条日志语句都new一个带stringstream的LogEvent，高频日志下
+     * 这笔分配在堆剖析里排在调度器前面。池化后事件用完（引用计数归零）
+     * 自动回池复用，稳态下只剩shared_ptr控制块一笔小分配。
+     * 跨线程释放（比如AsyncLogAppender的刷盘线程）回收进释放线程自己的池
+     */
+    static LogEvent::ptr Create(const std::string &logger_name, LogLevel::Level level, const char *file, int32_t line
+        , int64_t elapse, uint32_t thread_id, uint64_t cor_id, time_t time, const std::string &thread_name)
+    {
+        Pool &pool = GetPool();
+        LogEvent *event;
+        if (!pool.events.empty())
+        {
+            event = pool.events.back();
+            pool.events.pop_back();
+            event->reset(logger_name, level, file, line, elapse, thread_id, cor_id, time, thread_name);
+        }
+        else
+        {
+            event = new LogEvent(logger_name, level, file, line, elapse, thread_id, cor_id, time, thread_name);
+        }
+        return LogEvent::ptr(event, &LogEvent::Recycle);
+    }
+
+    /**
+     * @brief 复用池中事件时重置全部字段，stringstream原地清空不重建
+     */
+    void reset(const std::string &logger_name, LogLevel::Level level, const char *file, int32_t line
+        , int64_t elapse, uint32_t thread_id, uint64_t cor_id, time_t time, const std::string &thread_name)
+    {
+        m_loggerName = logger_name;
+        m_level = level;
+        m_file = file;
+        m_line = line;
+        m_elapse = elapse;
+        m_threadId = thread_id;
+        m_corId = cor_id;
+        m_time = time;
+        m_threadName = thread_name;
+        m_ss.str("");
+        m_ss.clear();
+    }
+
     /**
     * @brief 获取日志级别
     */
@@ -214,6 +272,46 @@ public:
      */
     void vprintf(const char *fmt, va_list ap);  
 
+private:
+    /// 每线程事件池的容量上限
+    static const size_t MAX_POOL_EVENTS = 64;
+
+    /**
+     * @brief 线程本地的事件池，线程退出时释放剩余事件
+     */
+    struct Pool {
+        std::vector<LogEvent *> events;
+
+        ~Pool()
+        {
+            for (auto *event : events) {
+                delete event;
+            }
+        }
+    };
+
+    /**
+     * @brief 获取当前线程的事件池
+     */
+    static Pool &GetPool()
+    {
+        static thread_local Pool t_pool;
+        return t_pool;
+    }
+
+    /**
+     * @brief shared_ptr的删除器，把用完的事件放回当前线程的池
+     */
+    static void Recycle(LogEvent *event)
+    {
+        Pool &pool = GetPool();
+        if (pool.events.size() < MAX_POOL_EVENTS) {
+            pool.events.push_back(event);
+        } else {
+            delete event;
+        }
+    }
+
 private:
     /// 日志级别
     LogLevel::Level m_level;
@@ -438,6 +536,86 @@ private:
     bool m_reopenError = false;
 };
 
+/**
+ * @brief 异步日志输出地
+ * @details 包装一个下游LogAppender（通常是FileLogAppender），log()只把
+ * 日志事件塞进有界无锁队列立即返回，由后台线程批量取出写给下游，
+ * 慢盘不会阻塞调用方所在的协程和调度线程。队列满时丢弃最旧的事件并计数
+*/
+class AsyncLogAppender : public LogAppender {
+public:
+    typedef std::shared_ptr<AsyncLogAppender> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] sink 下游日志输出地，实际的落盘由它完成
+     * @param[in] queue_size 队列容量，向上取整到2的幂
+     */
+    AsyncLogAppender(LogAppender::ptr sink, size_t queue_size = 8192);
+
+    /**
+     * @brief 析构函数，停止后台线程并把队列里剩余的日志事件写完
+     */
+    ~AsyncLogAppender();
+
+    /**
+     * @brief 写入日志，入队后立即返回
+     * @details 多生产者安全，队列满时丢弃最旧的事件为新事件腾位置
+     */
+    void log(LogEvent::ptr event) override;
+
+    /**
+     * @brief 将日志输出目标的配置转成YAML String
+     */
+    std::string toYamlString() override;
+
+    /**
+     * @brief 因队列满被丢弃的日志事件数
+     */
+    uint64_t getDroppedCount() const { return m_dropped; }
+
+private:
+    /**
+     * @brief 后台刷盘线程的入口函数，批量取出事件写给下游
+     */
+    void run();
+
+    /**
+     * @brief 出队一个日志事件
+     * @return 队列空返回false
+     */
+    bool dequeue(LogEvent::ptr &event);
+
+private:
+    /**
+     * @brief 队列槽位，seq序号按Vyukov有界队列的约定标记槽位归属，
+     * event本身由seq上的acquire/release保护，无需原子
+     */
+    struct Cell {
+        std::atomic<size_t> seq;
+        LogEvent::ptr event;
+    };
+
+    /// 下游日志输出地
+    LogAppender::ptr m_sink;
+    /// 环形队列
+    std::unique_ptr<Cell[]> m_buffer;
+    /// 下标掩码，容量-1
+    size_t m_mask = 0;
+    /// 入队位置
+    std::atomic<size_t> m_enqueuePos{0};
+    /// 出队位置
+    std::atomic<size_t> m_dequeuePos{0};
+    /// 丢弃的事件数
+    std::atomic<uint64_t> m_dropped{0};
+    /// 是否正在停止
+    std::atomic<bool> m_stopping{false};
+    /// 队列非空信号
+    Semaphore m_sem;
+    /// 后台刷盘线程
+    std::shared_ptr<Thread> m_thread;
+};
+
 /**
  * @brief 日志器类
  * @note 日志器类不带root logger
@@ -466,12 +644,14 @@ public:
     /**
      * @brief 设置日志级别
      */
-    void setLevel(LogLevel::Level level)  { m_level = level; }
+    void setLevel(LogLevel::Level level) { m_level.store(level, std::memory_order_relaxed); }
 
     /**
      * @brief 获取日志级别
+     * @details 每条日志语句的级别判断都要走这里，relaxed原子读，
+     * 内联后就是一条普通load，不产生任何同步开销
      */
-    LogLevel::Level getLevel() const {return m_level;}
+    LogLevel::Level getLevel() const { return m_level.load(std::memory_order_relaxed); }
 
     /**
      * @brieg 添加日志输出器
@@ -503,8 +683,8 @@ private:
     MutexType m_mutex;
     /// 日志器名称
     std::string m_name;
-    /// 日志器等级
-    LogLevel::Level m_level;
+    /// 日志器等级，原子存储，宏里的级别判断无锁读取
+    std::atomic<LogLevel::Level> m_level;
     /// 日志输出器集合
     std::list<LogAppender::ptr> m_appenders;
     /// 创建时间
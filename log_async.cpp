@@ -0,0 +1,151 @@
+/**
+ * @file log_async.cpp
+ * @brief 异步日志后端实现
+ * @details 有界MPSC无锁队列 + 后台刷盘线程，生产者入队即返回，
+ * 过载时丢弃最旧的事件，保证调度线程永远不会被慢盘拖住
+ * @version 0.1
+ * @date 2024-06-05
+ */
+
+#include <functional>
+#include <sstream>
+#include "log.h"
+
+namespace event
+{
+
+    AsyncLogAppender::AsyncLogAppender(LogAppender::ptr sink, size_t queue_size)
+        : LogAppender(sink->getFormatter()),
+          m_sink(sink)
+    {
+        size_t cap = 1;
+        while (cap < queue_size)
+        {
+            cap <<= 1;
+        }
+        m_mask = cap - 1;
+        m_buffer.reset(new Cell[cap]);
+        for (size_t i = 0; i < cap; ++i)
+        {
+            m_buffer[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        m_thread.reset(new Thread(std::bind(&AsyncLogAppender::run, this), "async_log"));
+    }
+
+    AsyncLogAppender::~AsyncLogAppender()
+    {
+        m_stopping = true;
+        m_sem.notify();
+        if (m_thread)
+        {
+            m_thread->join();
+        }
+        // 后台线程已退出，把队列里剩余的事件同步写完
+        LogEvent::ptr event;
+        while (dequeue(event))
+        {
+            m_sink->log(event);
+        }
+    }
+
+    void AsyncLogAppender::log(LogEvent::ptr event)
+    {
+        Cell *cell = nullptr;
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &m_buffer[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if (dif == 0)
+            {
+                // 槽位空闲，抢占入队位置
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                                       std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (dif < 0)
+            {
+                // 队列满，丢弃最旧的事件腾出位置，保证新日志优先保留
+                LogEvent::ptr dropped;
+                if (dequeue(dropped))
+                {
+                    ++m_dropped;
+                }
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+            else
+            {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->event = event;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        m_sem.notify();
+    }
+
+    bool AsyncLogAppender::dequeue(LogEvent::ptr &event)
+    {
+        Cell *cell = nullptr;
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &m_buffer[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (dif == 0)
+            {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1,
+                                                       std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (dif < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        event = cell->event;
+        cell->event.reset();
+        cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    void AsyncLogAppender::run()
+    {
+        LogEvent::ptr event;
+        while (true)
+        {
+            m_sem.wait();
+            // 醒来后把当前能看到的事件一次性批量写给下游
+            while (dequeue(event))
+            {
+                m_sink->log(event);
+                event.reset();
+            }
+            if (m_stopping)
+            {
+                break;
+            }
+        }
+    }
+
+    std::string AsyncLogAppender::toYamlString()
+    {
+        MutexType::Lock lock(m_mutex);
+        std::stringstream ss;
+        ss << "- type: AsyncLogAppender\n";
+        ss << "  dropped: " << m_dropped << "\n";
+        ss << "  sink:\n" << m_sink->toYamlString();
+        return ss.str();
+    }
+
+} // namespace event
@@ -6,10 +6,16 @@
  */
 
 #include <atomic>
+#include <cstring>
+#include <map>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
 #include "m_cor.h"
 #include "config.h"
 #include "log.h"
 #include "macro.h"
+#include "perf_counter.h"
 
 namespace event
 {
@@ -29,6 +35,19 @@ namespace event
     static ConfigVar<uint32_t>::ptr g_cor_stack_size =
         Config::Lookup<uint32_t>("cor.stack_size", 128 * 1024, "cor stack size");
 
+    /// 每个线程每种栈大小缓存的空闲栈数量上限，超过上限的栈直接释放
+    static ConfigVar<uint32_t>::ptr g_cor_stack_pool_cap =
+        Config::Lookup<uint32_t>("cor.stack_pool_cap", 64, "per-thread cached cor stacks per size bucket");
+
+    /// 线程共享栈大小，共享栈模式的协程都在这块栈上运行，默认1M
+    static ConfigVar<uint32_t>::ptr g_cor_shared_stack_size =
+        Config::Lookup<uint32_t>("cor.shared_stack_size", 1024 * 1024, "cor shared stack size");
+
+    /// 线程局部变量，本线程的共享栈，第一个共享栈协程运行时分配
+    static thread_local std::unique_ptr<char[]> t_shared_stack = nullptr;
+    /// 线程局部变量，共享栈上现场的属主协程，包括已yield但栈内容还在共享栈上的协程
+    static thread_local Cor *t_shared_owner = nullptr;
+
     /**
      * @brief malloc栈内存分配器
      */
@@ -39,7 +58,142 @@ namespace event
         static void Dealloc(void *vp, size_t size) { return free(vp); }
     };
 
-    using StackAllocator = MallocStackAllocator;
+    /**
+     * @brief mmap栈内存分配器，带保护页
+     * @details 匿名映射按需提交物理页，协程没用到的栈深度不占实际内存；
+     * 低地址多映射一页设为PROT_NONE作保护页，栈溢出时立即SIGSEGV，
+     * 而不是悄悄踩坏堆上的邻居。定义EVENT_COR_STACK_MMAP宏时启用
+     */
+    class MmapStackAllocator
+    {
+    public:
+        static void *Alloc(size_t size)
+        {
+            size_t page = (size_t)sysconf(_SC_PAGESIZE);
+            void *vp = mmap(nullptr, size + page, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (vp == MAP_FAILED)
+            {
+                EVENT_ASSERT2(false, "mmap");
+            }
+            // 栈向下增长，保护页放在低地址端
+            if (mprotect(vp, page, PROT_NONE))
+            {
+                EVENT_ASSERT2(false, "mprotect");
+            }
+            return (char *)vp + page;
+        }
+
+        static void Dealloc(void *vp, size_t size)
+        {
+            size_t page = (size_t)sysconf(_SC_PAGESIZE);
+            munmap((char *)vp - page, size + page);
+        }
+    };
+
+/// 底层栈分配后端，StackPool缓存的栈都来自它
+#ifdef EVENT_COR_STACK_MMAP
+    using RawStackAllocator = MmapStackAllocator;
+#else
+    using RawStackAllocator = MallocStackAllocator;
+#endif
+
+    /**
+     * @brief 线程局部协程栈池
+     * @details 协程析构释放的栈按大小分桶缓存在线程局部空闲链表里，
+     * 下次构造同样大小的协程时直接复用，省掉短生命周期协程的malloc/free。
+     * 相当于把Cor::reset()的栈复用自动推广到了所有协程。
+     * 空闲链表全部在线程内操作，无需加锁；每个桶的缓存数量由
+     * cor.stack_pool_cap限制，调小配置后多余的栈在归还时收缩释放，
+     * 线程退出时整个池子随之释放
+     */
+    class StackPool
+    {
+    public:
+        static void *Alloc(size_t size)
+        {
+            std::vector<void *> &bucket = GetBuckets().buckets[size];
+            if (!bucket.empty())
+            {
+                void *vp = bucket.back();
+                bucket.pop_back();
+                return vp;
+            }
+            return RawStackAllocator::Alloc(size);
+        }
+
+        static void Dealloc(void *vp, size_t size)
+        {
+            std::vector<void *> &bucket = GetBuckets().buckets[size];
+            size_t cap = g_cor_stack_pool_cap->getValue();
+            // 收缩：配置调小后把超出上限的缓存栈还给系统
+            while (bucket.size() > cap)
+            {
+                RawStackAllocator::Dealloc(bucket.back(), size);
+                bucket.pop_back();
+            }
+            if (bucket.size() < cap)
+            {
+                bucket.push_back(vp);
+                return;
+            }
+            RawStackAllocator::Dealloc(vp, size);
+        }
+
+    private:
+        /**
+         * @brief 空闲栈分桶容器，key为栈大小
+         * @details 包一层结构体是为了利用析构函数在线程退出时释放缓存的栈
+         */
+        struct Buckets
+        {
+            std::map<size_t, std::vector<void *>> buckets;
+
+            ~Buckets()
+            {
+                for (auto &i : buckets)
+                {
+                    for (auto vp : i.second)
+                    {
+                        RawStackAllocator::Dealloc(vp, i.first);
+                    }
+                }
+            }
+        };
+
+        static Buckets &GetBuckets()
+        {
+            static thread_local Buckets t_buckets;
+            return t_buckets;
+        }
+    };
+
+    using StackAllocator = StackPool;
+
+    /// 已注册的协程本地存储槽位数
+    static std::atomic<size_t> s_local_slot_count{0};
+    /// 各槽位的销毁函数，由AllocLocalSlot注册，注册后不再变更
+    static void (*s_local_destroyers[Cor::MAX_LOCAL_SLOTS])(void *);
+
+    size_t Cor::AllocLocalSlot(void (*destroy)(void *))
+    {
+        size_t index = s_local_slot_count++;
+        EVENT_ASSERT2(index < MAX_LOCAL_SLOTS, "too many cor local slots");
+        s_local_destroyers[index] = destroy;
+        return index;
+    }
+
+    void Cor::clearLocals()
+    {
+        for (size_t i = 0; i < MAX_LOCAL_SLOTS; i++)
+        {
+            if (m_locals[i])
+            {
+                s_local_destroyers[i](m_locals[i]);
+                m_locals[i] = nullptr;
+            }
+        }
+    }
 
     /// 获得当前线程正在运行的协程的Id
     uint64_t Cor::GetCorId()
@@ -56,11 +210,14 @@ namespace event
         SetThis(this);
         m_state = RUNNING;
 
+#ifndef EVENT_COR_FCONTEXT
         /// 获得当前上下文，如果getcontext成功，它将返回0，否则返回非0值
         if (getcontext(&m_ctx))
         {
             EVENT_ASSERT2(false, "getcontext");
         }
+#endif
+        /// 快速切换实现下主协程不需要初始化，m_sp在第一次切出时由event_cor_swap填充
 
         ++e_cor_count;
         m_id = e_cor_id++; // 协程id从0开始，用完加1
@@ -92,14 +249,27 @@ namespace event
     /**
      * 带参数的构造函数，用于创建其他协程，需要分配栈
      */
-    Cor::Cor(std::function<void()> cb, size_t stacksize)
+    Cor::Cor(std::function<void()> cb, size_t stacksize, bool shared_stack)
         : m_id(e_cor_id++),
+          m_sharedStack(shared_stack),
           m_cb(cb)
     {
         ++e_cor_count;
+        if (m_sharedStack)
+        {
+            /// 共享栈协程不独占栈，保存缓冲区按需增长，
+            /// 上下文推迟到第一次resume时在运行线程的共享栈上建立
+            EVENT_LOG_DEBUG(g_logger) << "Cor::Cor() shared stack id = " << m_id;
+            return;
+        }
+
         m_stacksize = stacksize ? stacksize : g_cor_stack_size->getValue();
         m_stack = StackAllocator::Alloc(m_stacksize);
 
+#ifdef EVENT_COR_FCONTEXT
+        /// 在协程栈顶伪造一个保存帧，第一次resume时直接"恢复"到入口函数
+        m_sp = event_cor_make(m_stack, m_stacksize, &Cor::MainFunc);
+#else
         /// 将m_ctx初始化并保存当前的上下文
         if (getcontext(&m_ctx))
         {
@@ -115,6 +285,7 @@ namespace event
 
         /// 使用这个函数对上下文进行处理，可以创建一个新的上下文
         makecontext(&m_ctx, &Cor::MainFunc, 0);
+#endif
 
         EVENT_LOG_DEBUG(g_logger) << "Cor::Cor() id = " << m_id;
     }
@@ -126,7 +297,21 @@ namespace event
     {
         EVENT_LOG_DEBUG(g_logger) << "Cor::~Cor() id = " << m_id;
         --e_cor_count;
-        if (m_stack)
+        clearLocals();
+        if (m_sharedStack)
+        {
+            // 共享栈协程，m_stack是保存缓冲区，不走栈池
+            EVENT_ASSERT(m_state == TERM);
+            if (t_shared_owner == this)
+            {
+                t_shared_owner = nullptr;
+            }
+            if (m_stack)
+            {
+                free(m_stack);
+            }
+        }
+        else if (m_stack)
         {
             // 有栈，说明是子协程，需要确保子协程一定是结束状态
             EVENT_ASSERT(m_state == TERM);
@@ -152,9 +337,25 @@ namespace event
      */
     void Cor::reset(std::function<void()> cb)
     {
-        EVENT_ASSERT(m_stack);
+        EVENT_ASSERT(m_stack || m_sharedStack);
         EVENT_ASSERT(m_state == TERM);
+        // 复用的协程不继承上一个任务的本地存储
+        clearLocals();
         m_cb = cb;
+        if (m_sharedStack)
+        {
+            // 丢弃旧的活跃栈，上下文在下次resume时重新建立
+            m_savedSize = 0;
+            if (t_shared_owner == this)
+            {
+                t_shared_owner = nullptr;
+            }
+            m_state = READY;
+            return;
+        }
+#ifdef EVENT_COR_FCONTEXT
+        m_sp = event_cor_make(m_stack, m_stacksize, &Cor::MainFunc);
+#else
         if (getcontext(&m_ctx))
         {
             EVENT_ASSERT2(false, "getcontext");
@@ -165,35 +366,140 @@ namespace event
         m_ctx.uc_stack.ss_size = m_stacksize;
 
         makecontext(&m_ctx, &Cor::MainFunc, 0);
+#endif
         m_state = READY;
     }
 
+    void Cor::prepareSharedStack()
+    {
+        uint32_t size = g_cor_shared_stack_size->getValue();
+        if (!t_shared_stack)
+        {
+            t_shared_stack.reset(new char[size]);
+        }
+        char *base = t_shared_stack.get();
+
+        if (t_shared_owner == this)
+        {
+            // 自己的现场还在共享栈上，直接切入
+            return;
+        }
+        if (t_shared_owner)
+        {
+            // 先把当前属主的活跃栈搬到它自己的保存缓冲区
+            t_shared_owner->saveSharedStack(base, size);
+        }
+
+        if (m_savedSize)
+        {
+            // 把上次保存的活跃栈拷回共享栈原位，绝对地址因此保持有效
+            memcpy(base + size - m_savedSize, m_stack, m_savedSize);
+        }
+        else
+        {
+            // 第一次运行（或reset后），在共享栈上建立上下文
+#ifdef EVENT_COR_FCONTEXT
+            m_sp = event_cor_make(base, size, &Cor::MainFunc);
+#else
+            if (getcontext(&m_ctx))
+            {
+                EVENT_ASSERT2(false, "getcontext");
+            }
+            m_ctx.uc_link = nullptr;
+            m_ctx.uc_stack.ss_sp = base;
+            m_ctx.uc_stack.ss_size = size;
+            makecontext(&m_ctx, &Cor::MainFunc, 0);
+#endif
+        }
+        t_shared_owner = this;
+    }
+
+    void Cor::saveSharedStack(char *base, uint32_t size)
+    {
+#ifdef EVENT_COR_FCONTEXT
+        // 快速切换实现保存的栈指针就是活跃栈的下边界
+        char *sp = (char *)m_sp;
+#else
+        char *sp = (char *)m_liveSp;
+#endif
+        if (sp < base)
+        {
+            sp = base;
+        }
+        m_savedSize = base + size - sp;
+        if (m_savedSize > m_stacksize)
+        {
+            // 保存缓冲区按活跃栈大小增长，只进不退，生命周期内复用
+            m_stack = realloc(m_stack, m_savedSize);
+            m_stacksize = m_savedSize;
+        }
+        memcpy(m_stack, sp, m_savedSize);
+    }
+
     void Cor::resume()
     {
         EVENT_ASSERT(m_state != TERM && m_state != RUNNING);
+        if (m_sharedStack)
+        {
+            // 此时运行在主协程自己的栈上，搬移共享栈内容是安全的
+            prepareSharedStack();
+        }
         SetThis(this);
         m_state = RUNNING;
+        // 一次resume配对一次yield，按resume计上下文切换
+        PerfCounters::Inc(PerfCounters::COR_SWITCHES);
 
+#ifdef EVENT_COR_FCONTEXT
+        event_cor_swap(&(t_thread_cor->m_sp), m_sp);
+#else
         if (swapcontext(&(t_thread_cor->m_ctx), &m_ctx))
         {
             EVENT_ASSERT2(false, "swapcontext");
         }
+#endif
+        // swap返回说明协程已经切出且现场保存完毕，READY此时才发布。
+        // 如果在yield里切换前就写READY，跨线程唤醒方（CoMutex的unlock、
+        // io_uring的收割线程）会在m_sp/m_ctx还是上一次现场时就resume它，
+        // 两个线程跑在同一个栈上。TERM由MainFunc在切出前设置，不覆盖
+        if (m_state.load(std::memory_order_relaxed) != TERM)
+        {
+            m_state.store(READY, std::memory_order_release);
+        }
     }
 
-    void yield()
+    void Cor::yield()
     {
         /// RUNNING/TERM的协程可调用，其中运行完的协程（TERM）会自动yield一次，用于回到主协程
-        EVENT_ASEERT(m_state == RUNNING || m_state == TERM);
+        EVENT_ASSERT(m_state == RUNNING || m_state == TERM);
         SetThis(t_thread_cor.get());
-        if (m_stata != TERM)
+        // READY不在这里写：要等对端resume()的swap返回、现场保存完毕后才发布
+
+        if (m_sharedStack)
         {
-            m_state = READY;
+            if (m_state == TERM)
+            {
+                // 结束的协程不再占用共享栈，后续切入者无需保存它的现场
+                t_shared_owner = nullptr;
+            }
+#ifndef EVENT_COR_FCONTEXT
+            else
+            {
+                // ucontext不暴露保存的栈指针，切出前用局部变量地址估计栈顶，
+                // 再留出一段余量；swapcontext的现场保存在m_ctx里，不依赖这段栈
+                char anchor;
+                m_liveSp = &anchor - 128;
+            }
+#endif
         }
 
+#ifdef EVENT_COR_FCONTEXT
+        event_cor_swap(&m_sp, t_thread_cor->m_sp);
+#else
         if (swapcontext(&m_ctx, &(t_thread_cor->m_ctx)))
         {
             EVENT_ASSERT2(false, "swapcontext");
         }
+#endif
     }
 
     /**
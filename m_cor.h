@@ -9,17 +9,21 @@
 #ifndef __event_Cor_H__
 #define __event_Cor_H__
 
+#include <atomic>
 #include <functional>
 #include <memory>
+#ifndef EVENT_COR_FCONTEXT
 #include <ucontext.h>
+#endif
 #include "thread.h"
+#include "fcontext.h"
 
 namespace event {
 
 /**
  * @brief 协程类
 */
-class Cor : public std::enable_shared_from this<Cor> {
+class Cor : public std::enable_shared_from_this<Cor> {
 public:
     typedef std::shared_ptr<Cor> ptr;
      
@@ -52,8 +56,14 @@ public:
      * 还需要给协程提供一个运行的栈空间
      * @param[] cb 协程入口函数
      * @param[] stacksize 栈大小
+     * @param[] shared_stack 是否运行在线程共享栈上。共享栈模式下协程不独占
+     * 128K的栈，而是在本线程的共享栈上运行，yield时只把活跃部分拷贝到
+     * 按需增长的保存缓冲区，内存占用从栈大小缩减到实际使用量，
+     * 适合大量长期挂起、栈很浅的协程
+     * @attention 共享栈协程的保存缓冲区里含有指向本线程共享栈的绝对地址，
+     * 只能在第一次resume它的线程上继续运行，跨线程调度时需用线程亲和性固定
     */
-    Cor(std::function<void()> cb, size_t stacksize = 0);
+    Cor(std::function<void()> cb, size_t stacksize = 0, bool shared_stack = false);
 
     /**
      * @brief 析构函数
@@ -68,7 +78,9 @@ public:
 
     /**
      * @brief 将当前协程切换到执行状态
-     * @details 当前协程和正在运行的协程进行交换，前者状态变成RUNNING，后者状态变成READY
+     * @details 当前协程和正在运行的协程进行交换，前者状态变成RUNNING，后者状态变成READY。
+     * 后者的READY在swap返回之后、也就是它的现场保存完毕之后才写入，
+     * 跨线程唤醒方以此判断协程可以被重新resume
      */
     void resume();
 
@@ -76,6 +88,8 @@ public:
      * @brief 当前协程让出执行权
      * @details 当前协程与上次resume时退到后台的协程进行交换，前者状态变成READY，
      * 后者状态变成RUNNING
+     * @attention READY状态不在本函数内写入，而是由对端resume()在swap返回后发布，
+     * 避免其他线程在现场尚未保存时就看到READY并抢先resume
      */
     void yield();
 
@@ -87,8 +101,10 @@ public:
   
     /**
      * @brief 获取协程状态
+     * @details READY状态由resume()在swap返回之后才发布（见resume的说明），
+     * 其他线程用acquire读到非RUNNING时，协程的现场一定已经保存完毕，可以安全resume
      */
-    State getState() const {return m_state;}
+    State getState() const {return m_state.load(std::memory_order_acquire);}
 
 public:
     /**
@@ -120,19 +136,77 @@ public:
    */
   static uint64_t GetCorId();
 
+public:
+    /// 协程本地存储的槽位数上限
+    static const size_t MAX_LOCAL_SLOTS = 16;
+
+    /**
+     * @brief 注册一个协程本地存储槽位，进程内全局分配，下标单调递增
+     * @details 配合CorLocal<T>使用，每个CorLocal在构造时注册一个槽位，
+     * 之后所有协程都用同一个下标O(1)访问自己的那份存储
+     * @param[] destroy 槽内对象的销毁函数，协程结束或reset时调用
+     * @return 槽位下标
+     */
+    static size_t AllocLocalSlot(void (*destroy)(void *));
+
+    /**
+     * @brief 按下标访问本协程的本地存储槽
+     * @details 存储挂在协程对象上，跟着协程在线程间迁移，
+     * 不存在thread_local在协程被调度到其他线程后错位的问题
+     */
+    void *&localSlot(size_t index)
+    {
+        return m_locals[index];
+    }
+
+private:
+    /**
+     * @brief 共享栈模式下，切入本协程前恢复/建立它在共享栈上的现场
+     * @details 先把共享栈当前属主的活跃栈保存走，再把本协程上次保存的
+     * 活跃栈拷贝回共享栈原位；首次运行时直接在共享栈上建立上下文
+     */
+    void prepareSharedStack();
+
+    /**
+     * @brief 把本协程在共享栈上的活跃部分保存到自己的缓冲区
+     * @param[] base 共享栈低地址
+     * @param[] size 共享栈大小
+     */
+    void saveSharedStack(char *base, uint32_t size);
+
+    /**
+     * @brief 销毁本协程全部的本地存储对象，协程析构和reset复用时调用
+     */
+    void clearLocals();
+
 private:
     /// 协程id
     uint64_t m_id = 0;
     /// 协程栈大小
     uint32_t m_stacksize = 0;
-    /// 协程状态
-    State m_state = READY;
+    /// 协程状态，跨线程唤醒方会读，READY的发布时机见resume()
+    std::atomic<State> m_state{READY};
+#ifdef EVENT_COR_FCONTEXT
+    /// 协程上下文，快速切换实现只需保存栈指针，寄存器保存在协程栈上
+    void *m_sp = nullptr;
+#else
     /// 协程上下文
     ucontext_t m_ctx;
-    /// 协程栈地址
-    void m_stack = nullptr;
+#endif
+    /// 协程栈地址，共享栈模式下是按需增长的活跃栈保存缓冲区
+    void *m_stack = nullptr;
+    /// 是否运行在线程共享栈上
+    bool m_sharedStack = false;
+    /// 共享栈模式下，保存缓冲区中活跃栈的字节数，0表示尚未运行或刚reset
+    uint32_t m_savedSize = 0;
+#ifndef EVENT_COR_FCONTEXT
+    /// 共享栈模式下切出时的栈顶位置，ucontext路径在yield前记录
+    void *m_liveSp = nullptr;
+#endif
     /// 协程入口函数
     std::function<void()> m_cb;
+    /// 协程本地存储槽，存放CorLocal<T>对象的指针，下标即注册的槽位
+    void *m_locals[MAX_LOCAL_SLOTS] = {};
 };
 
 } //namspace event
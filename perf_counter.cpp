@@ -0,0 +1,102 @@
+/**
+ * @file perf_counter.cpp
+ * @brief 运行时性能计数器实现
+ * @version 0.1
+ * @date 2024-06-11
+ */
+#include "perf_counter.h"
+#include <sstream>
+#include <vector>
+#include "macro.h"
+#include "thread.h"
+
+namespace event
+{
+
+    /// 保护计数槽注册表，只在线程第一次计数和读快照时使用
+    static Mutex s_slot_mutex;
+
+    std::vector<PerfCounters::Slot *> &PerfCounters::Slots()
+    {
+        static std::vector<Slot *> s_slots;
+        return s_slots;
+    }
+
+    PerfCounters::Slot *PerfCounters::GetSlot()
+    {
+        /// 当前线程的计数槽
+        static thread_local Slot *t_slot = nullptr;
+        if (EVENT_LIKELY(t_slot))
+        {
+            return t_slot;
+        }
+        t_slot = new Slot;
+        Mutex::Lock lock(s_slot_mutex);
+        Slots().push_back(t_slot);
+        return t_slot;
+    }
+
+    PerfCounters::Snapshot PerfCounters::GetSnapshot()
+    {
+        Snapshot snapshot;
+        Mutex::Lock lock(s_slot_mutex);
+        for (auto *slot : Slots())
+        {
+            for (int i = 0; i < COUNTER_COUNT; i++)
+            {
+                uint64_t value = slot->values[i].load(std::memory_order_relaxed);
+                if (i == QUEUE_DEPTH_HIGH_WATER)
+                {
+                    // 高水位类计数取各线程观察值的最大值
+                    if (value > snapshot.values[i])
+                    {
+                        snapshot.values[i] = value;
+                    }
+                }
+                else
+                {
+                    snapshot.values[i] += value;
+                }
+            }
+        }
+        return snapshot;
+    }
+
+    const char *PerfCounters::CounterName(Counter counter)
+    {
+        switch (counter)
+        {
+#define XX(name)   \
+    case name:     \
+        return #name;
+            XX(TASKS_EXECUTED);
+            XX(TASK_STEALS);
+            XX(STEAL_MISSES);
+            XX(QUEUE_DEPTH_HIGH_WATER);
+            XX(COR_SWITCHES);
+            XX(EPOLL_WAKEUPS);
+            XX(EVENTS_DISPATCHED);
+            XX(TICKLE_WRITES);
+            XX(INLINE_RUNS);
+#undef XX
+        default:
+            return "UNKNOWN";
+        }
+    }
+
+    std::string PerfCounters::ToString()
+    {
+        Snapshot snapshot = GetSnapshot();
+        std::stringstream ss;
+        for (int i = 0; i < COUNTER_COUNT; i++)
+        {
+            if (i)
+            {
+                ss << " ";
+            }
+            ss << CounterName((Counter)i) << "=" << snapshot.values[i];
+        }
+        return ss.str();
+    }
+
+} /// end namespace event
@@ -0,0 +1,139 @@
+/**
+ * @file perf_counter.h
+ * @brief 运行时性能计数器
+ * @version 0.1
+ * @date 2024-06-11
+ */
+
+#ifndef __EVENT_PERF_COUNTER_H__
+#define __EVENT_PERF_COUNTER_H__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace event
+{
+
+    /**
+     * @brief 进程级性能计数器
+     * @details 每个线程一个独占缓存行的计数槽，热路径上只对自己的槽做
+     * relaxed读改写，没有锁也没有跨线程的缓存行争用。GetSnapshot()按需
+     * 汇总所有线程的槽得到全局值，只在读侧花代价。
+     * 计数槽在线程第一次计数时注册，线程退出后槽保留，累计值不丢
+     */
+    class PerfCounters
+    {
+    public:
+        /**
+         * @brief 计数器类别
+         */
+        enum Counter
+        {
+            /// 调度器执行完成的任务数（协程resume返回一次记一次）
+            TASKS_EXECUTED = 0,
+            /// 工作窃取成功次数
+            TASK_STEALS,
+            /// 工作窃取落空次数（本地、共享、窃取都没拿到任务）
+            STEAL_MISSES,
+            /// 共享任务队列深度高水位（取所有线程观察值的最大值）
+            QUEUE_DEPTH_HIGH_WATER,
+            /// 协程上下文切换次数（一次resume记一次，与yield成对）
+            COR_SWITCHES,
+            /// epoll_wait返回次数，包括超时返回
+            EPOLL_WAKEUPS,
+            /// idle协程分发的IO就绪事件任务数
+            EVENTS_DISPATCHED,
+            /// tickle实际写eventfd的次数，被合并掉的tickle不计
+            TICKLE_WRITES,
+            /// 内联直达执行的任务数，经由交接槽不过队列的那部分
+            INLINE_RUNS,
+            /// 计数器个数
+            COUNTER_COUNT
+        };
+
+        /**
+         * @brief 当前线程的计数器加delta
+         * @param[in] counter 计数器类别
+         * @param[in] delta 增量
+         */
+        static void Inc(Counter counter, uint64_t delta = 1)
+        {
+            Slot *slot = GetSlot();
+            slot->values[counter].store(
+                slot->values[counter].load(std::memory_order_relaxed) + delta,
+                std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief 用value刷新当前线程计数器的最大值，用于高水位类计数
+         * @param[in] counter 计数器类别
+         * @param[in] value 观察值
+         */
+        static void UpdateMax(Counter counter, uint64_t value)
+        {
+            Slot *slot = GetSlot();
+            if (value > slot->values[counter].load(std::memory_order_relaxed))
+            {
+                slot->values[counter].store(value, std::memory_order_relaxed);
+            }
+        }
+
+        /**
+         * @brief 所有计数器的汇总快照
+         */
+        struct Snapshot
+        {
+            /// 各计数器的全局值，下标即Counter
+            uint64_t values[COUNTER_COUNT] = {0};
+        };
+
+        /**
+         * @brief 汇总所有线程的计数槽，生成一份全局快照
+         * @details 普通计数器求和，高水位类计数器取最大值。
+         * 只做relaxed读，不阻塞任何写入线程
+         */
+        static Snapshot GetSnapshot();
+
+        /**
+         * @brief 计数器名称
+         */
+        static const char *CounterName(Counter counter);
+
+        /**
+         * @brief 全部计数器的可读dump，便于打进日志
+         */
+        static std::string ToString();
+
+    private:
+        /**
+         * @brief 单线程的计数槽，独占缓存行，避免伪共享
+         */
+        struct alignas(64) Slot
+        {
+            std::atomic<uint64_t> values[COUNTER_COUNT];
+
+            Slot()
+            {
+                for (int i = 0; i < COUNTER_COUNT; i++)
+                {
+                    values[i].store(0, std::memory_order_relaxed);
+                }
+            }
+        };
+
+        /**
+         * @brief 获取当前线程的计数槽，第一次调用时分配并注册
+         */
+        static Slot *GetSlot();
+
+        /**
+         * @brief 所有线程的计数槽注册表，槽永不释放，数量以线程数为上界
+         */
+        static std::vector<Slot *> &Slots();
+    };
+
+} /// end namespace event
+
+#endif
@@ -0,0 +1,235 @@
+/**
+ * @file sched_stats.cpp
+ * @brief 调度延迟统计与卡死看门狗实现
+ * @version 0.1
+ * @date 2024-06-15
+ */
+#include "sched_stats.h"
+#include <sstream>
+#include <unistd.h>
+#include "config.h"
+#include "log.h"
+#include "macro.h"
+#include "thread.h"
+
+namespace event
+{
+
+    static event::Logger::ptr g_logger = EVENT_LOG_NAME("system");
+
+    /// 单个任务的运行时间预算，超出即认为卡住了工作线程，支持运行期热更
+    static ConfigVar<uint64_t>::ptr g_stall_budget_ms =
+        Config::Lookup<uint64_t>("scheduler.stall_budget_ms", 1000,
+                                 "scheduler stall watchdog budget in ms");
+
+    /// 保护统计槽注册表，只在线程第一次记录和读快照时使用
+    static Mutex s_slot_mutex;
+    /// 看门狗监控线程
+    static std::shared_ptr<Thread> s_watchdog;
+    /// 看门狗停止标志
+    static std::atomic<bool> s_watchdog_stop{false};
+
+    SchedStats::Slot::Slot()
+    {
+        for (size_t i = 0; i < BUCKETS; i++)
+        {
+            wait[i].store(0, std::memory_order_relaxed);
+            run[i].store(0, std::memory_order_relaxed);
+        }
+        runStartUs.store(0, std::memory_order_relaxed);
+        runCorId.store(0, std::memory_order_relaxed);
+        warnedStartUs.store(0, std::memory_order_relaxed);
+        threadId = event::GetThreadId();
+    }
+
+    std::vector<SchedStats::Slot *> &SchedStats::Slots()
+    {
+        static std::vector<Slot *> s_slots;
+        return s_slots;
+    }
+
+    SchedStats::Slot *SchedStats::GetSlot()
+    {
+        /// 当前线程的统计槽
+        static thread_local Slot *t_slot = nullptr;
+        if (EVENT_LIKELY(t_slot))
+        {
+            return t_slot;
+        }
+        t_slot = new Slot;
+        Mutex::Lock lock(s_slot_mutex);
+        Slots().push_back(t_slot);
+        return t_slot;
+    }
+
+    void SchedStats::Record(std::atomic<uint64_t> *buckets, uint64_t us)
+    {
+        // 2的幂分桶，桶i统计[2^(i-1), 2^i)微秒
+        size_t idx = 64 - __builtin_clzll(us | 1);
+        if (idx >= BUCKETS)
+        {
+            idx = BUCKETS - 1;
+        }
+        buckets[idx].store(buckets[idx].load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+    }
+
+    void SchedStats::RecordWait(uint64_t us)
+    {
+        Record(GetSlot()->wait, us);
+    }
+
+    void SchedStats::TaskBegin(uint64_t cor_id)
+    {
+        Slot *slot = GetSlot();
+        slot->runCorId.store(cor_id, std::memory_order_relaxed);
+        // 看门狗先读开始时间再读协程id，这里逆序写，id不会读到旧值
+        slot->runStartUs.store(NowUs(), std::memory_order_release);
+    }
+
+    void SchedStats::TaskEnd()
+    {
+        Slot *slot = GetSlot();
+        uint64_t start = slot->runStartUs.load(std::memory_order_relaxed);
+        slot->runStartUs.store(0, std::memory_order_release);
+        Record(slot->run, NowUs() - start);
+    }
+
+    /**
+     * 看门狗主循环：扫描所有线程槽上正在运行的任务，超预算的打WARN。
+     * 同一个开始时间戳只告警一次，任务换了之后才会再次触发
+     */
+    static void WatchdogRun()
+    {
+        EVENT_LOG_DEBUG(g_logger) << "sched watchdog start";
+        while (!s_watchdog_stop.load(std::memory_order_relaxed))
+        {
+            uint64_t budget_ms = g_stall_budget_ms->getValue();
+            SchedStats::CheckStalls(budget_ms);
+            // 扫描周期取预算的四分之一，告警延迟最多比预算多一个周期
+            uint64_t interval_us = budget_ms * 1000 / 4;
+            if (interval_us < 10000)
+            {
+                interval_us = 10000;
+            }
+            usleep(interval_us);
+        }
+        EVENT_LOG_DEBUG(g_logger) << "sched watchdog exit";
+    }
+
+    void SchedStats::CheckStalls(uint64_t budget_ms)
+    {
+        uint64_t now = NowUs();
+        Mutex::Lock lock(s_slot_mutex);
+        for (auto *slot : Slots())
+        {
+            uint64_t start = slot->runStartUs.load(std::memory_order_acquire);
+            if (!start || now - start < budget_ms * 1000)
+            {
+                continue;
+            }
+            // 同一次卡死不重复告警
+            if (slot->warnedStartUs.load(std::memory_order_relaxed) == start)
+            {
+                continue;
+            }
+            slot->warnedStartUs.store(start, std::memory_order_relaxed);
+            EVENT_LOG_WARN(g_logger) << "scheduler stall: thread=" << slot->threadId
+                                     << " cor=" << slot->runCorId.load(std::memory_order_relaxed)
+                                     << " running " << (now - start) / 1000
+                                     << "ms exceeds budget " << budget_ms << "ms";
+        }
+    }
+
+    void SchedStats::StartWatchdog()
+    {
+        Mutex::Lock lock(s_slot_mutex);
+        if (s_watchdog)
+        {
+            return;
+        }
+        s_watchdog_stop.store(false, std::memory_order_relaxed);
+        s_watchdog.reset(new Thread(&WatchdogRun, "sched_watchdog"));
+    }
+
+    void SchedStats::StopWatchdog()
+    {
+        std::shared_ptr<Thread> watchdog;
+        {
+            Mutex::Lock lock(s_slot_mutex);
+            watchdog.swap(s_watchdog);
+        }
+        if (watchdog)
+        {
+            s_watchdog_stop.store(true, std::memory_order_relaxed);
+            watchdog->join();
+        }
+    }
+
+    uint64_t SchedStats::Snapshot::Percentile(const uint64_t *buckets, double p)
+    {
+        uint64_t total = 0;
+        for (size_t i = 0; i < BUCKETS; i++)
+        {
+            total += buckets[i];
+        }
+        if (!total)
+        {
+            return 0;
+        }
+        uint64_t target = (uint64_t)(total * p);
+        if (!target)
+        {
+            target = 1;
+        }
+        uint64_t cum = 0;
+        for (size_t i = 0; i < BUCKETS; i++)
+        {
+            cum += buckets[i];
+            if (cum >= target)
+            {
+                // 返回所在桶的上界
+                return 1ull << i;
+            }
+        }
+        return 1ull << (BUCKETS - 1);
+    }
+
+    SchedStats::Snapshot SchedStats::GetSnapshot()
+    {
+        Snapshot snapshot;
+        Mutex::Lock lock(s_slot_mutex);
+        for (auto *slot : Slots())
+        {
+            for (size_t i = 0; i < BUCKETS; i++)
+            {
+                snapshot.wait[i] += slot->wait[i].load(std::memory_order_relaxed);
+                snapshot.run[i] += slot->run[i].load(std::memory_order_relaxed);
+            }
+        }
+        return snapshot;
+    }
+
+    std::string SchedStats::ToString()
+    {
+        Snapshot snapshot = GetSnapshot();
+        uint64_t wait_n = 0;
+        uint64_t run_n = 0;
+        for (size_t i = 0; i < BUCKETS; i++)
+        {
+            wait_n += snapshot.wait[i];
+            run_n += snapshot.run[i];
+        }
+        std::stringstream ss;
+        ss << "wait(us) p50=" << Snapshot::Percentile(snapshot.wait, 0.5)
+           << " p90=" << Snapshot::Percentile(snapshot.wait, 0.9)
+           << " p99=" << Snapshot::Percentile(snapshot.wait, 0.99)
+           << " n=" << wait_n
+           << " run(us) p50=" << Snapshot::Percentile(snapshot.run, 0.5)
+           << " p90=" << Snapshot::Percentile(snapshot.run, 0.9)
+           << " p99=" << Snapshot::Percentile(snapshot.run, 0.99)
+           << " n=" << run_n;
+        return ss.str();
+    }
+
+} /// end namespace event
@@ -0,0 +1,150 @@
+/**
+ * @file sched_stats.h
+ * @brief 调度延迟统计与卡死看门狗
+ * @version 0.1
+ * @date 2024-06-15
+ */
+
+#ifndef __EVENT_SCHED_STATS_H__
+#define __EVENT_SCHED_STATS_H__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <time.h>
+#include <vector>
+
+namespace event
+{
+
+    /**
+     * @brief 调度延迟统计与卡死看门狗
+     * @details 两类信号：延迟直方图和卡死告警。run()在任务入队时打时间戳，
+     * 取出resume前记录排队等待时间，resume返回后记录运行时间，按2的幂
+     * 分桶进每线程的直方图——和PerfCounters同一套路，热路径只对本线程
+     * 独占缓存行的槽做relaxed读改写。看门狗是一个独立的监控线程（不跑在
+     * 被监控的调度器上，所有工作线程都卡死它也能发现），周期性扫描各线程
+     * 正在运行的任务的开始时间，超出预算的打WARN日志带线程id和协程id，
+     * 同一次卡死只告警一次。预算由配置项scheduler.stall_budget_ms控制
+     */
+    class SchedStats
+    {
+    public:
+        /// 直方图桶数，桶i统计[2^(i-1), 2^i)微秒，覆盖到约36分钟
+        static const size_t BUCKETS = 32;
+
+        /**
+         * @brief 单调时钟的当前微秒数，入队和resume两侧配对使用
+         */
+        static uint64_t NowUs()
+        {
+            timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+        }
+
+        /**
+         * @brief 记录一次任务的排队等待时间（入队到resume）
+         * @param[in] us 等待的微秒数
+         */
+        static void RecordWait(uint64_t us);
+
+        /**
+         * @brief 任务即将resume，登记开始时间和协程id供看门狗检查
+         * @param[in] cor_id 任务协程的id
+         */
+        static void TaskBegin(uint64_t cor_id);
+
+        /**
+         * @brief 任务resume返回，记录本次运行时间并清除登记
+         */
+        static void TaskEnd();
+
+        /**
+         * @brief 启动看门狗监控线程，重复调用只生效一次
+         * @details 扫描周期取预算的四分之一，预算运行期可通过配置热更
+         */
+        static void StartWatchdog();
+
+        /**
+         * @brief 停止看门狗监控线程并等它退出
+         */
+        static void StopWatchdog();
+
+        /**
+         * @brief 扫描一轮所有线程正在运行的任务，超出预算的打WARN日志
+         * @details 看门狗周期调用，也可在外部按需手动触发一次
+         * @param[in] budget_ms 运行时间预算(毫秒)
+         */
+        static void CheckStalls(uint64_t budget_ms);
+
+        /**
+         * @brief 全部线程直方图的汇总快照
+         */
+        struct Snapshot
+        {
+            /// 排队等待时间直方图，桶i为[2^(i-1), 2^i)微秒的任务数
+            uint64_t wait[BUCKETS] = {0};
+            /// 任务运行时间直方图，分桶同上
+            uint64_t run[BUCKETS] = {0};
+
+            /**
+             * @brief 计算直方图的分位点
+             * @param[in] buckets 直方图桶数组
+             * @param[in] p 分位，如0.99
+             * @return 分位点所在桶的上界微秒数，无样本返回0
+             */
+            static uint64_t Percentile(const uint64_t *buckets, double p);
+        };
+
+        /**
+         * @brief 汇总所有线程的直方图，只做relaxed读，不阻塞写入线程
+         */
+        static Snapshot GetSnapshot();
+
+        /**
+         * @brief 两个直方图的p50/p90/p99/样本数的可读dump，便于打进日志
+         */
+        static std::string ToString();
+
+    private:
+        /**
+         * @brief 单线程的统计槽，独占缓存行，避免伪共享
+         */
+        struct alignas(64) Slot
+        {
+            /// 排队等待时间直方图
+            std::atomic<uint64_t> wait[BUCKETS];
+            /// 任务运行时间直方图
+            std::atomic<uint64_t> run[BUCKETS];
+            /// 当前任务的开始微秒时间戳，0表示没有任务在运行
+            std::atomic<uint64_t> runStartUs;
+            /// 当前任务的协程id
+            std::atomic<uint64_t> runCorId;
+            /// 已告警过的开始时间戳，同一次卡死不重复告警
+            std::atomic<uint64_t> warnedStartUs;
+            /// 槽所属的线程id
+            int threadId = 0;
+
+            Slot();
+        };
+
+        /**
+         * @brief 按2的幂分桶累加一次耗时样本
+         */
+        static void Record(std::atomic<uint64_t> *buckets, uint64_t us);
+
+        /**
+         * @brief 获取当前线程的统计槽，第一次调用时分配并注册
+         */
+        static Slot *GetSlot();
+
+        /**
+         * @brief 所有线程的统计槽注册表，槽永不释放
+         */
+        static std::vector<Slot *> &Slots();
+    };
+
+} /// end namespace event
+
+#endif
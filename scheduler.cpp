@@ -5,8 +5,18 @@
  * @date 2024-03-24
  */
 #include "scheduler.h"
+#include "hook.h"
 #include "macro.h"
 
+/// 自旋等待时提示CPU让出流水线资源，降低超线程兄弟核的干扰
+#if defined(__x86_64__) || defined(__i386__)
+#define EVENT_CPU_RELAX() asm volatile("pause" ::: "memory")
+#elif defined(__aarch64__)
+#define EVENT_CPU_RELAX() asm volatile("yield" ::: "memory")
+#else
+#define EVENT_CPU_RELAX() asm volatile("" ::: "memory")
+#endif
+
 namespace event
 {
 
@@ -16,13 +26,103 @@ namespace event
     static thread_local Scheduler *t_scheduler = nullptr;
     /// 当前线程的调度协程，每个线程都独有一份
     static thread_local Cor *t_scheduler_cor = nullptr;
+    /// 当前线程的本地队列序号，工作窃取模式下在run()入口分配，-1表示非调度线程
+    static thread_local int t_queue_idx = -1;
+    /// 当前线程的取任务轮次计数，用于优先级的加权轮转
+    static thread_local uint32_t t_pick_seq = 0;
+    /// 本线程的任务节点缓存
+    thread_local Scheduler::TaskSlab Scheduler::t_taskSlab;
+    /// 本线程的cb任务执行协程缓存
+    thread_local Scheduler::CorPool Scheduler::t_corPool;
+    /// 本线程的内联交接槽
+    thread_local Scheduler::ScheduleTask Scheduler::t_inlineNext;
+    /// 本线程连续内联执行的深度
+    thread_local uint32_t Scheduler::t_inlineDepth = 0;
+
+    Scheduler::TaskSlab::~TaskSlab()
+    {
+        for (auto *task : nodes)
+        {
+            delete task;
+        }
+        nodes.clear();
+    }
+
+    Cor::ptr Scheduler::AllocCbCor(std::function<void()> cb)
+    {
+        if (!t_corPool.cors.empty())
+        {
+            Cor::ptr cor = t_corPool.cors.back();
+            t_corPool.cors.pop_back();
+            // 复用TERM协程的栈，只换入口函数
+            cor->reset(cb);
+            return cor;
+        }
+        return Cor::ptr(new Cor(cb));
+    }
+
+    void Scheduler::FreeCbCor(Cor::ptr &cor)
+    {
+        // 半路yield的协程已被重新调度，别人还持有引用，不能回收
+        if (cor->getState() == Cor::TERM && cor.use_count() == 1 &&
+            t_corPool.cors.size() < MAX_POOL_CORS)
+        {
+            t_corPool.cors.push_back(cor);
+        }
+        cor.reset();
+    }
+
+    Scheduler::ScheduleTask *Scheduler::AllocTask()
+    {
+        if (!t_taskSlab.nodes.empty())
+        {
+            ScheduleTask *task = t_taskSlab.nodes.back();
+            t_taskSlab.nodes.pop_back();
+            return task;
+        }
+        return new ScheduleTask;
+    }
+
+    void Scheduler::FreeTask(ScheduleTask *task)
+    {
+        task->reset();
+        if (t_taskSlab.nodes.size() < MAX_SLAB_TASKS)
+        {
+            t_taskSlab.nodes.push_back(task);
+        }
+        else
+        {
+            delete task;
+        }
+    }
+
+    /**
+     * 选择本轮扫描的起始优先级：大部分轮次从HIGH开始，
+     * 每8轮让NORMAL先行一次、每16轮让LOW先行一次，避免低优先级被彻底饿死
+     */
+    static int PickStartPriority()
+    {
+        uint32_t seq = t_pick_seq++;
+        if ((seq & 15) == 15)
+        {
+            return Scheduler::PRIO_LOW;
+        }
+        if ((seq & 7) == 7)
+        {
+            return Scheduler::PRIO_NORMAL;
+        }
+        return Scheduler::PRIO_HIGH;
+    }
 
-    Scheduler::Scheduler(size_t threads, bool use_caller, const std::string &name)
+    Scheduler::Scheduler(size_t threads, bool use_caller, const std::string &name, bool work_steal,
+                         bool inline_run)
     {
         EVENT_ASSERT(threads > 0);
 
         m_useCaller = use_caller;
         m_name = name;
+        m_workSteal = work_steal;
+        m_inlineRun = inline_run;
 
         if (use_caller)
         {
@@ -47,6 +147,119 @@ namespace event
             m_rootThread = -1;
         }
         m_threadCount = threads;
+
+        if (m_workSteal)
+        {
+            // 每个调度线程一个本地队列，use_caller时caller线程也算一个
+            size_t queues = m_threadCount + (use_caller ? 1 : 0);
+            m_localQueues.resize(queues);
+            for (size_t i = 0; i < queues; i++)
+            {
+                m_localQueues[i].reset(new WorkStealQueue<ScheduleTask>);
+            }
+        }
+    }
+
+    WorkStealQueue<Scheduler::ScheduleTask> *Scheduler::getLocalQueue()
+    {
+        if (GetThis() != this || t_queue_idx < 0 ||
+            t_queue_idx >= (int)m_localQueues.size())
+        {
+            return nullptr;
+        }
+        return m_localQueues[t_queue_idx].get();
+    }
+
+    bool Scheduler::tryInlineNext(ScheduleTask &task)
+    {
+        // 必须在调度线程的任务协程里，调度协程本身没有"yield后"这个时机
+        if (!t_scheduler_cor || Cor::GetThis().get() == t_scheduler_cor)
+        {
+            return false;
+        }
+        // 指定了其他线程的任务必须走共享队列
+        if (task.thread != -1 && task.thread != event::GetThreadId())
+        {
+            return false;
+        }
+        // 连续内联太深说明任务链很长，退回队列给其他线程分担的机会
+        if (t_inlineDepth >= MAX_INLINE_DEPTH)
+        {
+            return false;
+        }
+        if (t_inlineNext.cor || t_inlineNext.cb)
+        {
+            return false;
+        }
+        task.enqueueUs = SchedStats::NowUs();
+        t_inlineNext = std::move(task);
+        return true;
+    }
+
+    bool Scheduler::takeTask(ScheduleTask &task, bool &tickle_me)
+    {
+        WorkStealQueue<ScheduleTask> *local = m_localQueues[t_queue_idx].get();
+
+        // 1. 本地队列，无锁LIFO，刚提交的任务数据还是热的
+        ScheduleTask *t = local->pop();
+
+        // 2. 共享队列，存放指定了线程的任务、非普通优先级的任务和本地队列满时溢出的任务
+        if (!t)
+        {
+            MutexType::Lock lock(m_mutex);
+            int start = PickStartPriority();
+            for (int i = 0; i < PRIO_COUNT; i++)
+            {
+                auto &queue = m_tasks[(start + i) % PRIO_COUNT];
+                auto it = queue.begin();
+                while (it != queue.end())
+                {
+                    if (it->thread != -1 && it->thread != event::GetThreadId())
+                    {
+                        ++it;
+                        tickle_me = true;
+                        continue;
+                    }
+                    EVENT_ASSERT(it->cor || it->cb);
+                    task = std::move(*it);
+                    recycleNodeNoLock(queue, it++);
+                    --m_pendingTasks;
+                    ++m_activeThreadCount;
+                    tickle_me |= (it != queue.end());
+                    return true;
+                }
+            }
+        }
+
+        // 3. 其他线程的本地队列，从自己的下一个开始轮询窃取
+        if (!t)
+        {
+            for (size_t i = 1; i < m_localQueues.size() && !t; i++)
+            {
+                size_t victim = (t_queue_idx + i) % m_localQueues.size();
+                t = m_localQueues[victim]->steal();
+            }
+            if (t)
+            {
+                PerfCounters::Inc(PerfCounters::TASK_STEALS);
+            }
+            else
+            {
+                PerfCounters::Inc(PerfCounters::STEAL_MISSES);
+            }
+        }
+
+        if (t)
+        {
+            task = std::move(*t);
+            FreeTask(t);
+            --m_pendingTasks;
+            ++m_activeThreadCount;
+            // 本地还有剩余时唤醒别的线程来偷
+            tickle_me |= !local->empty();
+            return true;
+        }
+        return false;
     }
 
     Scheduler *Scheduler::GetThis()
@@ -88,22 +301,79 @@ namespace event
         }
     }
 
+    void Scheduler::scheduleTasks(std::vector<ScheduleTask> &tasks)
+    {
+        bool need_tickle = false;
+        {
+            MutexType::Lock lock(m_mutex);
+            need_tickle = tasksEmptyNoLock();
+            for (auto &task : tasks)
+            {
+                if (task.cor || task.cb)
+                {
+                    enqueueNoLock(std::move(task));
+                }
+            }
+        }
+        tasks.clear();
+        if (need_tickle)
+        {
+            tickle();
+        }
+    }
+
     bool Scheduler::stopping()
     {
         MutexType::Lock lock(m_mutex);
-        return m_stopping && m_tasks.empty() && m_activeThreadCount == 0;
+        bool tasks_empty = tasksEmptyNoLock();
+        for (auto &queue : m_localQueues)
+        {
+            tasks_empty &= queue->empty();
+        }
+        return m_stopping && tasks_empty && m_activeThreadCount == 0;
     }
 
     void Scheduler::tickle()
     {
-        EVENT_LOG_DEBUG(g_logger) << "ticlke";
+        // 只有真有线程睡在信号量上才post，避免无谓的系统调用
+        if (m_parkedThreads.load() > 0)
+        {
+            m_idleSem.notify();
+        }
     }
 
     void Scheduler::idle()
     {
         EVENT_LOG_DEBUG(g_logger) << "idle";
+        /// 停靠前的自旋次数，量级取一次线程唤醒的开销（几微秒）
+        static const int SPIN_COUNT = 4000;
         while (!stopping())
         {
+            // 自旋阶段：只读原子计数，不碰m_mutex，任务到达时立即返回调度
+            bool busy = false;
+            for (int i = 0; i < SPIN_COUNT; i++)
+            {
+                if (m_pendingTasks.load() > 0 || m_stopping.load())
+                {
+                    busy = true;
+                    break;
+                }
+                EVENT_CPU_RELAX();
+            }
+
+            if (!busy)
+            {
+                // 停靠阶段：先登记自己，再复查一次计数，和tickle()构成
+                // 对向的写读序，不会有任务入队后无人唤醒的窗口
+                ++m_parkedThreads;
+                if (m_pendingTasks.load() == 0 && !m_stopping.load())
+                {
+                    m_idleSem.wait();
+                }
+                --m_parkedThreads;
+            }
+
+            // 回到调度协程去取任务
             event::Cor::GetThis()->yield();
         }
     }
@@ -158,12 +428,21 @@ namespace event
     void Scheduler::run()
     {
         EVENT_LOG_DEBUG(g_logger) << "run";
+        // 调度线程开启hook，阻塞型系统调用自动协程化
+        set_hook_enable(true);
         setThis();
         if (event::GetThreadId() != m_rootThread)
         {
             t_scheduler_cor = event::Cor::GetThis().get();
         }
 
+        if (m_workSteal)
+        {
+            // 领取本线程的本地队列
+            t_queue_idx = m_queueAlloc++;
+            EVENT_ASSERT(t_queue_idx < (int)m_localQueues.size());
+        }
+
         Cor::ptr idle_cor(new Cor(std::bind(&Scheduler::idle, this)));
         Cor::ptr cb_cor;
 
@@ -172,35 +451,60 @@ namespace event
         {
             task.reset();
             bool tickle_me = false; // 是否tickle其他线程进行任务调度
+            if (m_inlineRun && (t_inlineNext.cor || t_inlineNext.cb))
             {
+                // 上一个任务运行中通过交接槽交来的后继，直接执行，不碰队列
+                task = std::move(t_inlineNext);
+                t_inlineNext.reset();
+                ++t_inlineDepth;
+                ++m_activeThreadCount;
+                PerfCounters::Inc(PerfCounters::INLINE_RUNS);
+            }
+            else if (m_workSteal)
+            {
+                t_inlineDepth = 0;
+                takeTask(task, tickle_me);
+            }
+            else
+            {
+                t_inlineDepth = 0;
                 MutexType::Lock lock(m_mutex);
-                auto it = m_tasks.begin();
-                // 遍历所有调度任务
-                while (it != m_tasks.end())
+                // 按加权轮转选出的起始优先级依次扫描各级队列
+                int start = PickStartPriority();
+                bool found = false;
+                for (int i = 0; i < PRIO_COUNT && !found; i++)
                 {
-                    if (it->thread != -1 && it->thread != event::GetThreadId())
+                    auto &queue = m_tasks[(start + i) % PRIO_COUNT];
+                    auto it = queue.begin();
+                    // 遍历该优先级的调度任务
+                    while (it != queue.end())
                     {
-                        // 指定了调度线程，但不是在当前线程上调度，标记一下需要通知其他线程进行调度，然后跳过这个任务，继续下一个
-                        ++it;
-                        tickle_me = true;
-                        continue;
-                    }
+                        if (it->thread != -1 && it->thread != event::GetThreadId())
+                        {
+                            // 指定了调度线程，但不是在当前线程上调度，标记一下需要通知其他线程进行调度，然后跳过这个任务，继续下一个
+                            ++it;
+                            tickle_me = true;
+                            continue;
+                        }
 
-                    // 找到一个未指定线程，或是指定了当前线程的任务
-                    EVENT_ASSERT(it->cor || it->cb);
-                    if (it->cor)
-                    {
-                        // 任务队列时的协程一定是READY状态，谁会把RUNNING或TERM状态的协程加入调度呢？
-                        EVENT_ASSERT(it->cor->getState() == Cor::READY);
+                        // 找到一个未指定线程，或是指定了当前线程的任务
+                        EVENT_ASSERT(it->cor || it->cb);
+                        if (it->cor)
+                        {
+                            // 任务队列时的协程一定是READY状态，谁会把RUNNING或TERM状态的协程加入调度呢？
+                            EVENT_ASSERT(it->cor->getState() == Cor::READY);
+                        }
+                        // 当前调度线程找到一个任务，准备开始调度，将其从任务队列中剔除，活动线程数加1
+                        task = std::move(*it);
+                        recycleNodeNoLock(queue, it++);
+                        --m_pendingTasks;
+                        ++m_activeThreadCount;
+                        found = true;
+                        break;
                     }
-                    // 当前调度线程找到一个任务，准备开始调度，将其从任务队列中剔除，活动线程数加1
-                    task = *it;
-                    m_tasks.erase(it++);
-                    ++m_activeThreadCount;
-                    break;
+                    // 当前线程拿完一个任务后，发现任务队列还有剩余，那么tickle一下其他线程
+                    tickle_me |= (it != queue.end());
                 }
-                // 当前线程拿完一个任务后，发现任务队列还有剩余，那么tickle一下其他线程
-                tickle_me |= (it != m_tasks.end());
             }
 
             if (tickle_me)
@@ -208,27 +512,38 @@ namespace event
                 tickle();
             }
 
+            // 记录任务从入队到被取出的排队等待时间
+            if (task.enqueueUs)
+            {
+                SchedStats::RecordWait(SchedStats::NowUs() - task.enqueueUs);
+            }
+
             if (task.cor)
             {
                 // resume协程，resume返回时，协程要么执行完了，要么半路yield了，总之这个任务就算完成了，活跃线程数减一
+                SchedStats::TaskBegin(task.cor->getId());
                 task.cor->resume();
+                SchedStats::TaskEnd();
                 --m_activeThreadCount;
+                PerfCounters::Inc(PerfCounters::TASKS_EXECUTED);
                 task.reset();
             }
             else if (task.cb)
             {
-                if (cb_cor)
-                {
-                    cb_cor->reset(task.cb);
-                }
-                else
-                {
-                    cb_cor.reset(new Cor(task.cb));
-                }
+                // cb任务的执行协程从线程缓存reset复用，把move-only的
+                // 回调搬进shared_ptr，适配Cor的std::function入口
+                auto fn = std::make_shared<TaskFn>(std::move(task.cb));
+                std::function<void()> wrapped = [fn]()
+                { (*fn)(); };
+                cb_cor = AllocCbCor(wrapped);
                 task.reset();
+                SchedStats::TaskBegin(cb_cor->getId());
                 cb_cor->resume();
+                SchedStats::TaskEnd();
                 --m_activeThreadCount;
-                cb_cor.reset();
+                PerfCounters::Inc(PerfCounters::TASKS_EXECUTED);
+                // 执行完的协程回缓存，下个cb任务连栈一起复用
+                FreeCbCor(cb_cor);
             }
             else
             {
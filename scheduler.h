@@ -8,19 +8,17 @@
 #ifndef __EVENT_SCHEDULER_H__
 #define __EVENT_SCHEDULER_H__
 
-#include <functional>
-#include
-
-#endif // !__EVENT_SCHEDULER_H__
-#define __EVENT_SCHEDULER_H__
-
 #include <functional>
 #include <list>
 #include <memory>
 #include <string>
 #include "m_cor.h"
 #include "log.h"
+#include "perf_counter.h"
+#include "sched_stats.h"
+#include "small_function.h"
 #include "thread.h"
+#include "work_steal_queue.h"
 
 namespace event
 {
@@ -36,13 +34,38 @@ namespace event
         typedef std::shared_ptr<Scheduler> ptr;
         typedef Mutex MutexType;
 
+        /**
+         * @brief 任务优先级
+         * @details 少量固定的优先级类别。调度时大部分轮次从HIGH开始取，
+         * 周期性地从NORMAL/LOW开始，保证批量后台任务不会把低延迟任务
+         * 挤到后面，低优先级也不会被完全饿死
+         */
+        enum Priority
+        {
+            /// 高优先级，延迟敏感的任务
+            PRIO_HIGH = 0,
+            /// 普通优先级，默认
+            PRIO_NORMAL = 1,
+            /// 低优先级，批量后台任务
+            PRIO_LOW = 2,
+            /// 优先级类别数
+            PRIO_COUNT = 3
+        };
+
         /**
          * @brief 创建调度器
          * @param[in] threads 线程数
          * @param[in] use_caller 是否将当前线程也作为调度线程
          * @param[in] name 名称
+         * @param[in] work_steal 是否启用工作窃取模式，每个调度线程持有一个
+         * 本地无锁双端队列，未指定线程的任务进本地队列，本地队列空了再去
+         * 共享队列取或者从其他线程窃取，避免所有线程争抢一把m_mutex
+         * @param[in] inline_run 是否启用内联直达模式，调度线程在任务协程里
+         * 提交的后继任务，队列为空时不入队，当前协程yield后由run()直接
+         * resume，省掉两次加锁和一次tickle，适合续体式的任务链
          */
-        Scheduler(size_t threads = 1, bool use_caller = true, const std::string &name = "Scheduler");
+        Scheduler(size_t threads = 1, bool use_caller = true, const std::string &name = "Scheduler",
+                  bool work_steal = false, bool inline_run = false);
 
         /**
          * @brief 析构函数
@@ -69,14 +92,55 @@ namespace event
          * @tparam CorOrCb 调度任务类型，可以是协程对象或者函数指针
          * @param[] cc 协程对象或指针
          * @param[] thread 指定运行该任务的线程，-1表示任意线程
+         * @param[] priority 任务优先级，见Priority
          */
-        template <Class CorOrCb>
-        void schedule(CorOrCb cc, int thread = -1)
+        template <class CorOrCb>
+        void schedule(CorOrCb cc, int thread = -1, int priority = PRIO_NORMAL)
         {
+            // 内联直达模式下，调度线程在任务协程里提交的任务，队列为空时
+            // 存进本线程的交接槽，当前协程yield后由run()直接resume，
+            // 不过队列、不加锁、不tickle；深度超限或条件不满足退回正常路径
+            if (m_inlineRun && GetThis() == this &&
+                m_pendingTasks.load(std::memory_order_relaxed) == 0)
+            {
+                if (priority < PRIO_HIGH || priority >= PRIO_COUNT)
+                {
+                    priority = PRIO_NORMAL;
+                }
+                ScheduleTask task(cc, thread, priority);
+                if (!task.cor && !task.cb)
+                {
+                    return;
+                }
+                if (tryInlineNext(task))
+                {
+                    return;
+                }
+                bool need_tickle = false;
+                {
+                    MutexType::Lock lock(m_mutex);
+                    need_tickle = tasksEmptyNoLock();
+                    enqueueNoLock(std::move(task));
+                }
+                if (need_tickle)
+                {
+                    tickle();
+                }
+                return;
+            }
+
+            // 工作窃取模式下，调度线程提交的未指定线程的普通优先级任务直接进本地队列，不加锁
+            // 非普通优先级的任务走共享的分级队列，保证优先级全局生效
+            if (m_workSteal && thread == -1 && priority == PRIO_NORMAL && scheduleLocal(cc))
+            {
+                tickle();
+                return;
+            }
+
             bool need_tickle = false;
             {
                 MutexType::Lock lock(m_mutex);
-                need_tickle = scheduleNoLock(cc, thread);
+                need_tickle = scheduleNoLock(cc, thread, priority);
             }
 
             if (need_tickle)
@@ -85,6 +149,32 @@ namespace event
             }
         }
 
+        /**
+         * @brief 批量添加调度任务
+         * @details 整批任务只取一次m_mutex、最多tickle一次，代替逐个schedule()
+         * 的N次加锁和N次唤醒，用于IO就绪事件、到期定时器这类一次产生一批任务的场景
+         * @tparam InputIterator 迭代器类型，解引用后是协程对象或函数指针
+         * @param[] begin 起始迭代器
+         * @param[] end 结束迭代器
+         */
+        template <class InputIterator>
+        void schedule(InputIterator begin, InputIterator end)
+        {
+            bool need_tickle = false;
+            {
+                MutexType::Lock lock(m_mutex);
+                while (begin != end)
+                {
+                    need_tickle = scheduleNoLock(*begin, -1) || need_tickle;
+                    ++begin;
+                }
+            }
+            if (need_tickle)
+            {
+                tickle();
+            }
+        }
+
         /**
          * @brief 启动调度器
          */
@@ -108,6 +198,10 @@ namespace event
 
         /**
          * @brief 无任务调度时执行idle协程
+         * @details 自适应策略：先带pause指令自旋一小段，只读原子的
+         * 待执行任务计数，不碰m_mutex；自旋落空后停到信号量上睡眠，
+         * 由tickle()唤醒。突发负载间隙不再烧整核空转，新任务到达时
+         * 自旋阶段能立即接住，唤醒延迟只在真正睡下后才出现
          */
         virtual void idle();
 
@@ -121,77 +215,315 @@ namespace event
          */
         void setThis();
 
-    private:
         /**
-         * @brief 添加调度任务，无锁
-         * @tparam CorOrCb 调度任务类型，可以是协程对象或者函数指针
-         * @param[] cc 协程对象或指针
-         * @param[] thread 指定运行该任务的线程，-1表示任意线程
+         * @brief 返回是否有空闲线程
+         * @details 调度协程进入idle时空闲线程数加1，从idle协程返回时空闲线程数减1
          */
-        template <Class CorOrCb>
-        void scheduleNoLock(CorOrCb cc, int thread = -1)
-        {
-            bool need_tickle = m_tasks.empty();
-            ScheduleTask task(cc, thread);
-            if (task.cor || task.cb)
-            {
-                m_tasks.push_back(task);
-            }
-            return need_tickle;
-        }
+        bool hasIdleThreads() { return m_idleThreadCount > 0; }
+
+        /// 任务回调类型，48字节内联缓冲区，覆盖绝大多数捕获，大捕获才落堆
+        typedef SmallFunction<48> TaskFn;
 
-    private:
         /**
          * @brief 调度任务，协程/函数二选一，可以指定在哪个线程上调度
+         * @details 回调用TaskFn内联存储，任务本身只支持移动，
+         * 提交到执行全程不产生拷贝
          */
         struct ScheduleTask
         {
             Cor::ptr cor;
-            std::function<void()> cb;
+            TaskFn cb;
             int thread;
+            int priority;
+            /// 入队时刻的微秒时间戳，run()取出时据此记录排队等待时间
+            uint64_t enqueueUs = 0;
 
-            ScheduleTask(Cor::ptr c, int thr)
+            ScheduleTask(Cor::ptr c, int thr, int prio = PRIO_NORMAL)
             {
                 cor = c;
                 thread = thr;
+                priority = prio;
             }
-            ScheduleTask(Cor::ptr *c, int thr)
+            ScheduleTask(Cor::ptr *c, int thr, int prio = PRIO_NORMAL)
             {
                 cor.swap(*c);
                 thread = thr;
+                priority = prio;
             }
-            ScheduleTask(std::function<void()> f, int thr)
+            template <class F, class = typename std::enable_if<
+                                   !std::is_convertible<typename std::decay<F>::type, Cor::ptr>::value &&
+                                   !std::is_same<typename std::decay<F>::type, Cor::ptr *>::value>::type>
+            ScheduleTask(F &&f, int thr, int prio = PRIO_NORMAL)
             {
-                cb = f;
+                cb = TaskFn(std::forward<F>(f));
                 thread = thr;
+                priority = prio;
+            }
+            ScheduleTask()
+            {
+                thread = -1;
+                priority = PRIO_NORMAL;
             }
-            ScheduleTask() { thread = -1; }
+            ScheduleTask(ScheduleTask &&) = default;
+            ScheduleTask &operator=(ScheduleTask &&) = default;
 
             void reset()
             {
                 cor = nullptr;
                 cb = nullptr;
                 thread = -1;
+                priority = PRIO_NORMAL;
+                enqueueUs = 0;
             }
         };
 
+        /**
+         * @brief 批量提交已构造好的调度任务，一次加锁，最多tickle一次
+         * @details 供子类（IOManager）把一轮epoll_wait收集到的就绪任务整批提交，
+         * 提交完成后tasks被清空
+         */
+        void scheduleTasks(std::vector<ScheduleTask> &tasks);
+
     private:
+        /**
+         * @brief 尝试把任务放入当前线程的本地工作窃取队列
+         * @details 仅当当前线程是本调度器的调度线程时才能入本地队列，
+         * 外部线程提交以及本地队列满时返回false，退回共享队列路径
+         * @tparam CorOrCb 调度任务类型，可以是协程对象或者函数指针
+         * @param[] cc 协程对象或指针
+         * @return 是否已入本地队列
+         */
+        template <class CorOrCb>
+        bool scheduleLocal(CorOrCb cc)
+        {
+            WorkStealQueue<ScheduleTask> *queue = getLocalQueue();
+            if (!queue)
+            {
+                return false;
+            }
+            ScheduleTask *task = AllocTask();
+            *task = ScheduleTask(cc, -1);
+            if (!task->cor && !task->cb)
+            {
+                FreeTask(task);
+                return true;
+            }
+            task->enqueueUs = SchedStats::NowUs();
+            if (!queue->push(task))
+            {
+                // 本地队列满，退回共享队列
+                FreeTask(task);
+                return false;
+            }
+            ++m_pendingTasks;
+            return true;
+        }
+
+        /**
+         * @brief 获取当前线程的本地工作窃取队列
+         * @return 当前线程不是本调度器的调度线程时返回nullptr
+         */
+        WorkStealQueue<ScheduleTask> *getLocalQueue();
+
+        /**
+         * @brief 本地队列任务节点的线程缓存，线程退出时释放剩余节点
+         * @details 本地队列按指针存任务，节点出队后回线程缓存复用，
+         * 被窃取的节点由窃取线程回收进窃取线程自己的缓存
+         */
+        struct TaskSlab
+        {
+            std::vector<ScheduleTask *> nodes;
+            ~TaskSlab();
+        };
+
+        /**
+         * @brief cb任务执行协程的线程缓存
+         * @details run()给每个cb任务配的执行协程在TERM后不销毁，
+         * 回缓存等下一个cb任务reset复用，协程对象和128K的栈都不重新分配
+         */
+        struct CorPool
+        {
+            std::vector<Cor::ptr> cors;
+        };
+
+        /**
+         * @brief 取一个cb任务的执行协程，优先从线程缓存reset复用
+         * @param[in] cb 协程入口函数
+         */
+        static Cor::ptr AllocCbCor(std::function<void()> cb);
+
+        /**
+         * @brief 归还cb任务的执行协程
+         * @details 只有TERM且无其他持有者的协程才回缓存；半路yield的协程
+         * 已被重新调度，持有权在任务队列那边，这里只释放自己的引用
+         * @param[in,out] cor 待归还的协程，返回时置空
+         */
+        static void FreeCbCor(Cor::ptr &cor);
+
+        /**
+         * @brief 分配一个本地队列任务节点，优先取线程缓存
+         */
+        static ScheduleTask *AllocTask();
+
+        /**
+         * @brief 回收一个本地队列任务节点到线程缓存，缓存满了直接释放
+         */
+        static void FreeTask(ScheduleTask *task);
+
+        /**
+         * @brief 尝试把任务放进本线程的内联交接槽
+         * @details 仅当当前线程是本调度器的调度线程、正运行在任务协程里
+         * （这样才存在"当前协程yield后"这个接手时机）、任务未指定到其他
+         * 线程、交接槽空闲且连续内联深度未超上限时成功。成功后任务不入
+         * 队列也不计入m_pendingTasks，由本线程的run()在当前协程yield后
+         * 直接resume
+         * @param[in,out] task 待交接的任务，成功时被move走
+         * @return 是否已放入交接槽
+         */
+        bool tryInlineNext(ScheduleTask &task);
+
+        /**
+         * @brief 工作窃取模式下获取一个任务
+         * @details 依次尝试：本地队列pop -> 共享队列（指定线程的任务和
+         * 本地队列满时溢出的任务）-> 从其他线程的队列steal
+         * @param[out] task 取到的任务
+         * @param[out] tickle_me 是否需要tickle其他线程
+         * @return 是否取到任务
+         */
+        bool takeTask(ScheduleTask &task, bool &tickle_me);
+
+        /**
+         * @brief 添加调度任务，无锁
+         * @tparam CorOrCb 调度任务类型，可以是协程对象或者函数指针
+         * @param[] cc 协程对象或指针
+         * @param[] thread 指定运行该任务的线程，-1表示任意线程
+         */
+        template <class CorOrCb>
+        bool scheduleNoLock(CorOrCb cc, int thread = -1, int priority = PRIO_NORMAL)
+        {
+            if (priority < PRIO_HIGH || priority >= PRIO_COUNT)
+            {
+                priority = PRIO_NORMAL;
+            }
+            bool need_tickle = tasksEmptyNoLock();
+            ScheduleTask task(cc, thread, priority);
+            if (task.cor || task.cb)
+            {
+                enqueueNoLock(std::move(task));
+            }
+            return need_tickle;
+        }
+
+        /**
+         * @brief 把任务挂到对应优先级的队尾，优先复用空闲链表里的节点
+         * @details std::list每次push_back都要分配一个链表节点，把出队后的
+         * 节点splice到m_freeTasks攒起来，入队时再splice回去并move赋值，
+         * 稳态下入队出队都不碰堆。调用方需持有m_mutex
+         */
+        void enqueueNoLock(ScheduleTask &&task)
+        {
+            PerfCounters::UpdateMax(PerfCounters::QUEUE_DEPTH_HIGH_WATER,
+                                    m_tasks[PRIO_HIGH].size() + m_tasks[PRIO_NORMAL].size() +
+                                        m_tasks[PRIO_LOW].size() + 1);
+            task.enqueueUs = SchedStats::NowUs();
+            ++m_pendingTasks;
+            auto &queue = m_tasks[task.priority];
+            if (!m_freeTasks.empty())
+            {
+                queue.splice(queue.end(), m_freeTasks, m_freeTasks.begin());
+                queue.back() = std::move(task);
+            }
+            else
+            {
+                queue.push_back(std::move(task));
+            }
+        }
+
+        /**
+         * @brief 任务出队后回收链表节点到空闲链表，超过容量上限才真正释放
+         * @details 调用方需持有m_mutex，调用前应已将任务move走
+         */
+        void recycleNodeNoLock(std::list<ScheduleTask> &queue, std::list<ScheduleTask>::iterator it)
+        {
+            it->reset();
+            if (m_freeTasks.size() < MAX_FREE_TASKS)
+            {
+                m_freeTasks.splice(m_freeTasks.end(), queue, it);
+            }
+            else
+            {
+                queue.erase(it);
+            }
+        }
+
+        /**
+         * @brief 所有优先级的共享队列是否都为空，调用方需持有m_mutex
+         */
+        bool tasksEmptyNoLock() const
+        {
+            for (int i = 0; i < PRIO_COUNT; i++)
+            {
+                if (!m_tasks[i].empty())
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    private:
+        /// 共享队列空闲节点链表的容量上限
+        static const size_t MAX_FREE_TASKS = 1024;
+        /// 每个线程的任务节点缓存容量上限
+        static const size_t MAX_SLAB_TASKS = 256;
+        /// 连续内联执行的深度上限，超过后退回队列，避免任务链饿死队列
+        static const size_t MAX_INLINE_DEPTH = 32;
+        /// 每个线程的执行协程缓存容量上限
+        static const size_t MAX_POOL_CORS = 64;
+        /// 本线程的任务节点缓存
+        static thread_local TaskSlab t_taskSlab;
+        /// 本线程的cb任务执行协程缓存
+        static thread_local CorPool t_corPool;
+        /// 本线程的内联交接槽，存放当前协程yield后直接执行的后继任务
+        static thread_local ScheduleTask t_inlineNext;
+        /// 本线程连续内联执行的深度，从队列取到任务或进idle时清零
+        static thread_local uint32_t t_inlineDepth;
+
         /// 协程调度器名称
         std::string m_name;
         /// 互斥锁
         MutexType m_mutex;
         /// 线程池
         std::vector<Thread::ptr> m_threads;
-        /// 任务队列
-        std::list<ScheduleTask> m_tasks;
+        /// 分优先级的任务队列，下标即Priority
+        std::list<ScheduleTask> m_tasks[PRIO_COUNT];
+        /// 出队后回收的空闲链表节点，入队时splice复用，避免反复分配
+        std::list<ScheduleTask> m_freeTasks;
         /// 线程池的线程ID数组
         std::vector<int> m_threadIds;
         /// 工作线程数量，不包含use_caller的主线程
         size_t m_threadCount = 0;
         /// 活跃线程数
-        std::atomic<size_t> m_activeThreadCount = {0};
+        /// 以下计数器被不同线程独立高频更新，各自独占一个缓存行，
+        /// 避免一个线程的写把其他线程正在读的相邻计数一起打失效
+        alignas(64) std::atomic<size_t> m_activeThreadCount = {0};
         /// idle线程数
-        std::atomic<size_t> m_idleThreadCount = {0};
+        alignas(64) std::atomic<size_t> m_idleThreadCount = {0};
+        /// 待执行任务计数，含共享队列和本地队列，idle自旋只读这一个原子
+        alignas(64) std::atomic<size_t> m_pendingTasks = {0};
+        /// 停在信号量上睡眠的idle线程数，tickle只在有人睡着时才post
+        alignas(64) std::atomic<size_t> m_parkedThreads = {0};
+        /// idle线程的停靠信号量
+        Semaphore m_idleSem;
+
+        /// 是否启用工作窃取
+        bool m_workSteal = false;
+        /// 是否启用内联直达
+        bool m_inlineRun = false;
+        /// 每个调度线程的本地任务队列，工作窃取模式下使用，下标即线程序号
+        std::vector<std::shared_ptr<WorkStealQueue<ScheduleTask>>> m_localQueues;
+        /// 本地队列序号分配器，调度线程在run()入口领取自己的队列
+        std::atomic<size_t> m_queueAlloc = {0};
 
         /// 是否use caller
         bool m_useCaller;
@@ -201,7 +533,7 @@ namespace event
         int m_rootThread = 0;
 
         /// 是否正在停止
-        bool m_stopping = false;
+        std::atomic<bool> m_stopping = {false};
     };
 
 } /// end namespace event
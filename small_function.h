@@ -0,0 +1,198 @@
+/**
+ * @file small_function.h
+ * @brief 小捕获内联存储的可调用对象封装
+ * @version 0.1
+ * @date 2024-06-09
+ */
+
+#ifndef __EVENT_SMALL_FUNCTION_H__
+#define __EVENT_SMALL_FUNCTION_H__
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace event
+{
+
+    /**
+     * @brief 无参无返回值的可调用对象封装，小捕获内联存储
+     * @details std::function的内联缓冲区很小（libstdc++下只够放一个指针），
+     * 调度回调常见的几十字节捕获都会落到堆上。这里提供Bytes字节的内联
+     * 缓冲区，捕获放得下就原地构造，放不下才退回堆分配。只支持移动，
+     * 移动即转移所有权，调度路径上任务只会从提交方移到执行方，不需要拷贝
+     * @tparam Bytes 内联缓冲区大小
+     */
+    template <size_t Bytes>
+    class SmallFunction
+    {
+    public:
+        SmallFunction() = default;
+
+        template <class F, class = typename std::enable_if<
+                               !std::is_same<typename std::decay<F>::type, SmallFunction>::value>::type>
+        SmallFunction(F &&f)
+        {
+            assign(std::forward<F>(f));
+        }
+
+        SmallFunction(SmallFunction &&other) noexcept
+        {
+            moveFrom(other);
+        }
+
+        SmallFunction &operator=(SmallFunction &&other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                moveFrom(other);
+            }
+            return *this;
+        }
+
+        SmallFunction(const SmallFunction &) = delete;
+        SmallFunction &operator=(const SmallFunction &) = delete;
+
+        ~SmallFunction()
+        {
+            reset();
+        }
+
+        SmallFunction &operator=(std::nullptr_t)
+        {
+            reset();
+            return *this;
+        }
+
+        /// 是否持有可调用对象
+        explicit operator bool() const
+        {
+            return m_vtable != nullptr;
+        }
+
+        void operator()()
+        {
+            m_vtable->invoke(m_storage);
+        }
+
+        /**
+         * @brief 释放持有的可调用对象
+         */
+        void reset()
+        {
+            if (m_vtable)
+            {
+                m_vtable->destroy(m_storage);
+                m_vtable = nullptr;
+            }
+        }
+
+    private:
+        /**
+         * @brief 手写虚表，按持有类型分发调用/移动/析构
+         * @details 比继承体系省一次堆分配，每个实例只多一个指针
+         */
+        struct VTable
+        {
+            void (*invoke)(void *storage);
+            void (*move)(void *dst, void *src);
+            void (*destroy)(void *storage);
+        };
+
+        /// 内联存储版本，可调用对象直接构造在m_storage里
+        template <class F>
+        struct InlineImpl
+        {
+            static void invoke(void *storage)
+            {
+                (*static_cast<F *>(storage))();
+            }
+            static void move(void *dst, void *src)
+            {
+                new (dst) F(std::move(*static_cast<F *>(src)));
+                static_cast<F *>(src)->~F();
+            }
+            static void destroy(void *storage)
+            {
+                static_cast<F *>(storage)->~F();
+            }
+            static const VTable *vtable()
+            {
+                static const VTable vt = {&invoke, &move, &destroy};
+                return &vt;
+            }
+        };
+
+        /// 堆存储版本，m_storage里只放一个指针
+        template <class F>
+        struct HeapImpl
+        {
+            static F *&slot(void *storage)
+            {
+                return *static_cast<F **>(storage);
+            }
+            static void invoke(void *storage)
+            {
+                (*slot(storage))();
+            }
+            static void move(void *dst, void *src)
+            {
+                *static_cast<F **>(dst) = slot(src);
+                slot(src) = nullptr;
+            }
+            static void destroy(void *storage)
+            {
+                delete slot(storage);
+            }
+            static const VTable *vtable()
+            {
+                static const VTable vt = {&invoke, &move, &destroy};
+                return &vt;
+            }
+        };
+
+        template <class F>
+        void assign(F &&f)
+        {
+            typedef typename std::decay<F>::type Fn;
+            doAssign<Fn>(std::forward<F>(f),
+                         std::integral_constant<bool, sizeof(Fn) <= Bytes &&
+                                                          alignof(Fn) <= alignof(std::max_align_t)>());
+        }
+
+        template <class Fn, class F>
+        void doAssign(F &&f, std::true_type)
+        {
+            new (m_storage) Fn(std::forward<F>(f));
+            m_vtable = InlineImpl<Fn>::vtable();
+        }
+
+        template <class Fn, class F>
+        void doAssign(F &&f, std::false_type)
+        {
+            *reinterpret_cast<Fn **>(m_storage) = new Fn(std::forward<F>(f));
+            m_vtable = HeapImpl<Fn>::vtable();
+        }
+
+        void moveFrom(SmallFunction &other)
+        {
+            m_vtable = other.m_vtable;
+            if (m_vtable)
+            {
+                m_vtable->move(m_storage, other.m_storage);
+                other.m_vtable = nullptr;
+            }
+        }
+
+    private:
+        /// 类型虚表，空值时为nullptr
+        const VTable *m_vtable = nullptr;
+        /// 内联缓冲区，小捕获的可调用对象原地构造，大捕获只放一个堆指针
+        alignas(std::max_align_t) unsigned char m_storage[Bytes < sizeof(void *) ? sizeof(void *) : Bytes];
+    };
+
+} /// end namespace event
+
+#endif
@@ -0,0 +1,64 @@
+/**
+ * @file test_work_steal_queue.cpp
+ * @brief 工作窃取队列的边界测试
+ * @details 重点覆盖空队列上的pop：pop先减bottom再和top比较，
+ * 下标必须有符号，否则新建队列上第一次pop就会回绕读到脏槽位并
+ * 永久打坏bottom。自包含，无外部依赖，g++ -o test test_work_steal_queue.cpp即可
+ * @version 0.1
+ * @date 2024-06-16
+ */
+
+#include <cassert>
+#include <cstdio>
+#include "../work_steal_queue.h"
+
+int main()
+{
+    event::WorkStealQueue<int> queue(8);
+
+    // 新建队列上pop/steal必须返回空，且不破坏队列状态
+    assert(queue.pop() == nullptr);
+    assert(queue.steal() == nullptr);
+    assert(queue.empty());
+
+    // 空pop之后push必须仍然可用（bottom回绕的话这里会一直失败）
+    int a = 1, b = 2, c = 3;
+    assert(queue.push(&a));
+    assert(queue.push(&b));
+    assert(queue.push(&c));
+    assert(!queue.empty());
+
+    // 属主端LIFO出队
+    assert(queue.pop() == &c);
+    assert(queue.pop() == &b);
+    assert(queue.pop() == &a);
+    assert(queue.empty());
+
+    // 取空之后再pop，同样必须返回空且可继续使用
+    assert(queue.pop() == nullptr);
+    assert(queue.pop() == nullptr);
+    assert(queue.push(&a));
+    assert(queue.steal() == &a);
+    assert(queue.steal() == nullptr);
+    assert(queue.pop() == nullptr);
+
+    // 反复清空再填满，验证下标跨越容量边界后仍然正确
+    for (int round = 0; round < 4; round++)
+    {
+        int vals[8];
+        for (int i = 0; i < 8; i++)
+        {
+            assert(queue.push(&vals[i]));
+        }
+        // 满了再push必须失败
+        assert(!queue.push(&a));
+        for (int i = 7; i >= 0; i--)
+        {
+            assert(queue.pop() == &vals[i]);
+        }
+        assert(queue.pop() == nullptr);
+    }
+
+    printf("test_work_steal_queue passed\n");
+    return 0;
+}
@@ -0,0 +1,254 @@
+/**
+ * @file timer.cpp
+ * @brief 定时器模块实现
+ * @version 0.1
+ * @date 2024-05-30
+ */
+
+#include "timer.h"
+#include "util.h"
+
+namespace event
+{
+
+    bool Timer::Comparator::operator()(const Timer::ptr &lhs, const Timer::ptr &rhs) const
+    {
+        if (!lhs && !rhs)
+        {
+            return false;
+        }
+        if (!lhs)
+        {
+            return true;
+        }
+        if (!rhs)
+        {
+            return false;
+        }
+        if (lhs->m_next < rhs->m_next)
+        {
+            return true;
+        }
+        if (rhs->m_next < lhs->m_next)
+        {
+            return false;
+        }
+        // 到期时间相同时按地址排序，保证set里的定时器互不相等
+        return lhs.get() < rhs.get();
+    }
+
+    Timer::Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager *manager)
+        : m_recurring(recurring),
+          m_ms(ms),
+          m_cb(cb),
+          m_manager(manager)
+    {
+        m_next = event::GetElapsed() + m_ms;
+    }
+
+    Timer::Timer(uint64_t next)
+        : m_next(next)
+    {
+    }
+
+    bool Timer::cancel()
+    {
+        TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
+        if (m_cb)
+        {
+            m_cb = nullptr;
+            auto it = m_manager->m_timers.find(shared_from_this());
+            m_manager->m_timers.erase(it);
+            return true;
+        }
+        return false;
+    }
+
+    bool Timer::refresh()
+    {
+        TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
+        if (!m_cb)
+        {
+            return false;
+        }
+        auto it = m_manager->m_timers.find(shared_from_this());
+        if (it == m_manager->m_timers.end())
+        {
+            return false;
+        }
+        // 先摘除再修改到期时间，避免破坏set的有序性
+        m_manager->m_timers.erase(it);
+        m_next = event::GetElapsed() + m_ms;
+        m_manager->m_timers.insert(shared_from_this());
+        return true;
+    }
+
+    bool Timer::reset(uint64_t ms, bool from_now)
+    {
+        if (ms == m_ms && !from_now)
+        {
+            return true;
+        }
+        TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
+        if (!m_cb)
+        {
+            return false;
+        }
+        auto it = m_manager->m_timers.find(shared_from_this());
+        if (it == m_manager->m_timers.end())
+        {
+            return false;
+        }
+        m_manager->m_timers.erase(it);
+        uint64_t start = 0;
+        if (from_now)
+        {
+            start = event::GetElapsed();
+        }
+        else
+        {
+            start = m_next - m_ms;
+        }
+        m_ms = ms;
+        m_next = start + m_ms;
+        m_manager->addTimer(shared_from_this(), lock);
+        return true;
+    }
+
+    TimerManager::TimerManager()
+    {
+        m_previouseTime = event::GetElapsed();
+    }
+
+    TimerManager::~TimerManager()
+    {
+    }
+
+    Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb, bool recurring)
+    {
+        Timer::ptr timer(new Timer(ms, cb, recurring, this));
+        RWMutexType::WriteLock lock(m_mutex);
+        addTimer(timer, lock);
+        return timer;
+    }
+
+    /**
+     * 条件定时器回调的包装，到期时条件对象还活着才执行真正的回调
+     */
+    static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb)
+    {
+        std::shared_ptr<void> tmp = weak_cond.lock();
+        if (tmp)
+        {
+            cb();
+        }
+    }
+
+    Timer::ptr TimerManager::addConditionTimer(uint64_t ms, std::function<void()> cb,
+                                               std::weak_ptr<void> weak_cond, bool recurring)
+    {
+        return addTimer(ms, std::bind(&OnTimer, weak_cond, cb), recurring);
+    }
+
+    uint64_t TimerManager::getNextTimer()
+    {
+        RWMutexType::ReadLock lock(m_mutex);
+        m_tickled = false;
+        if (m_timers.empty())
+        {
+            return ~0ull;
+        }
+
+        const Timer::ptr &next = *m_timers.begin();
+        uint64_t now_ms = event::GetElapsed();
+        if (now_ms >= next->m_next)
+        {
+            return 0;
+        }
+        return next->m_next - now_ms;
+    }
+
+    void TimerManager::listExpiredCb(std::vector<std::function<void()>> &cbs)
+    {
+        uint64_t now_ms = event::GetElapsed();
+        std::vector<Timer::ptr> expired;
+        {
+            RWMutexType::ReadLock lock(m_mutex);
+            if (m_timers.empty())
+            {
+                return;
+            }
+        }
+        RWMutexType::WriteLock lock(m_mutex);
+        if (m_timers.empty())
+        {
+            return;
+        }
+        bool rollover = detectClockRollover(now_ms);
+        if (!rollover && ((*m_timers.begin())->m_next > now_ms))
+        {
+            return;
+        }
+
+        Timer::ptr now_timer(new Timer(now_ms));
+        // 时钟回拨时把所有定时器都视为已到期
+        auto it = rollover ? m_timers.end() : m_timers.lower_bound(now_timer);
+        while (it != m_timers.end() && (*it)->m_next == now_ms)
+        {
+            ++it;
+        }
+        expired.insert(expired.begin(), m_timers.begin(), it);
+        m_timers.erase(m_timers.begin(), it);
+
+        cbs.reserve(cbs.size() + expired.size());
+        for (auto &timer : expired)
+        {
+            cbs.push_back(timer->m_cb);
+            if (timer->m_recurring)
+            {
+                // 循环定时器重新入堆
+                timer->m_next = now_ms + timer->m_ms;
+                m_timers.insert(timer);
+            }
+            else
+            {
+                timer->m_cb = nullptr;
+            }
+        }
+    }
+
+    bool TimerManager::hasTimer()
+    {
+        RWMutexType::ReadLock lock(m_mutex);
+        return !m_timers.empty();
+    }
+
+    void TimerManager::addTimer(Timer::ptr val, RWMutexType::WriteLock &lock)
+    {
+        auto it = m_timers.insert(val).first;
+        bool at_front = (it == m_timers.begin()) && !m_tickled;
+        if (at_front)
+        {
+            m_tickled = true;
+        }
+        lock.unlock();
+
+        if (at_front)
+        {
+            // 最近到期时间提前了，唤醒idle协程重设epoll_wait超时
+            onTimerInsertedAtFront();
+        }
+    }
+
+    bool TimerManager::detectClockRollover(uint64_t now_ms)
+    {
+        bool rollover = false;
+        if (now_ms < m_previouseTime && now_ms < (m_previouseTime - 60 * 60 * 1000))
+        {
+            rollover = true;
+        }
+        m_previouseTime = now_ms;
+        return rollover;
+    }
+
+} // namespace event
@@ -0,0 +1,173 @@
+/**
+ * @file timer.h
+ * @brief 定时器模块
+ * @details 基于最小堆（std::set按到期时间排序）的定时器管理器，
+ * 由IOManager继承，到期回调以任务形式交给调度器执行
+ * @version 0.1
+ * @date 2024-05-30
+ */
+
+#ifndef __EVENT_TIMER_H__
+#define __EVENT_TIMER_H__
+
+#include <functional>
+#include <memory>
+#include <set>
+#include <vector>
+#include "mutex.h"
+
+namespace event
+{
+
+    class TimerManager;
+
+    /**
+     * @brief 定时器
+     */
+    class Timer : public std::enable_shared_from_this<Timer>
+    {
+        friend class TimerManager;
+
+    public:
+        typedef std::shared_ptr<Timer> ptr;
+
+        /**
+         * @brief 取消定时器
+         */
+        bool cancel();
+
+        /**
+         * @brief 刷新定时器的执行时间，到期时间推迟到当前时间+周期
+         */
+        bool refresh();
+
+        /**
+         * @brief 重置定时器周期
+         * @param[in] ms 定时器执行间隔(毫秒)
+         * @param[in] from_now 是否从当前时间开始计算
+         */
+        bool reset(uint64_t ms, bool from_now);
+
+    private:
+        /**
+         * @brief 构造函数，只能由TimerManager创建
+         * @param[in] ms 定时器执行间隔(毫秒)
+         * @param[in] cb 回调函数
+         * @param[in] recurring 是否循环执行
+         * @param[in] manager 所属定时器管理器
+         */
+        Timer(uint64_t ms, std::function<void()> cb, bool recurring, TimerManager *manager);
+
+        /**
+         * @brief 构造函数，仅用于构造查找用的key
+         * @param[in] next 绝对到期时间(毫秒)
+         */
+        Timer(uint64_t next);
+
+    private:
+        /// 是否循环定时器
+        bool m_recurring = false;
+        /// 执行周期
+        uint64_t m_ms = 0;
+        /// 绝对到期时间
+        uint64_t m_next = 0;
+        /// 回调函数
+        std::function<void()> m_cb;
+        /// 所属定时器管理器
+        TimerManager *m_manager = nullptr;
+
+    private:
+        /**
+         * @brief 定时器比较仿函数，按绝对到期时间从小到大排序
+         */
+        struct Comparator
+        {
+            bool operator()(const Timer::ptr &lhs, const Timer::ptr &rhs) const;
+        };
+    };
+
+    /**
+     * @brief 定时器管理器
+     * @details 虚基类，由IOManager继承，onTimerInsertedAtFront用于在
+     * 最近到期时间提前时唤醒阻塞在epoll_wait上的idle协程，重新计算超时
+     */
+    class TimerManager
+    {
+        friend class Timer;
+
+    public:
+        typedef RWMutex RWMutexType;
+
+        TimerManager();
+
+        virtual ~TimerManager();
+
+        /**
+         * @brief 添加定时器
+         * @param[in] ms 定时器执行间隔(毫秒)
+         * @param[in] cb 回调函数
+         * @param[in] recurring 是否循环定时器
+         */
+        Timer::ptr addTimer(uint64_t ms, std::function<void()> cb, bool recurring = false);
+
+        /**
+         * @brief 添加条件定时器
+         * @details 到期时weak_cond仍然有效才执行cb，用于给对象绑定超时回调，
+         * 对象析构后定时器自动失效
+         * @param[in] ms 定时器执行间隔(毫秒)
+         * @param[in] cb 回调函数
+         * @param[in] weak_cond 条件
+         * @param[in] recurring 是否循环定时器
+         */
+        Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb,
+                                     std::weak_ptr<void> weak_cond, bool recurring = false);
+
+        /**
+         * @brief 距离最近一个定时器到期还有多久(毫秒)
+         * @return 没有定时器返回~0ull
+         */
+        uint64_t getNextTimer();
+
+        /**
+         * @brief 取出所有已到期定时器的回调函数
+         * @param[out] cbs 回调函数数组，循环定时器在取出的同时重新入堆
+         */
+        void listExpiredCb(std::vector<std::function<void()>> &cbs);
+
+        /**
+         * @brief 是否有定时器
+         */
+        bool hasTimer();
+
+    protected:
+        /**
+         * @brief 当有新的定时器插入到堆顶时执行该函数
+         * @details 意味着最近的到期时间提前了，需要中断当前的epoll_wait重设超时
+         */
+        virtual void onTimerInsertedAtFront() = 0;
+
+        /**
+         * @brief 将定时器添加到管理器中
+         */
+        void addTimer(Timer::ptr val, RWMutexType::WriteLock &lock);
+
+    private:
+        /**
+         * @brief 检测服务器时间是否被往回调了
+         */
+        bool detectClockRollover(uint64_t now_ms);
+
+    private:
+        /// Mutex
+        RWMutexType m_mutex;
+        /// 定时器集合，按到期时间排序
+        std::set<Timer::ptr, Timer::Comparator> m_timers;
+        /// 是否已经触发过onTimerInsertedAtFront，避免重复唤醒
+        bool m_tickled = false;
+        /// 上次执行时间，用于检测时钟回拨
+        uint64_t m_previouseTime = 0;
+    };
+
+} // namespace event
+
+#endif
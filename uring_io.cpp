@@ -0,0 +1,222 @@
+/**
+ * @file uring_io.cpp
+ * @brief io_uring异步IO实现
+ * @details 不依赖liburing，直接用裸系统调用和mmap操作SQ/CQ环
+ * @version 0.1
+ * @date 2024-06-14
+ */
+
+#ifdef EVENT_IO_URING
+
+#include <sched.h>       // for sched_yield()
+#include <string.h>      // for memset()
+#include <sys/eventfd.h> // for eventfd()
+#include <sys/mman.h>    // for mmap()
+#include <sys/syscall.h> // for __NR_io_uring_xxx
+#include <unistd.h>      // for syscall()
+#include "uring_io.h"
+#include "log.h"
+#include "macro.h"
+
+namespace event
+{
+
+    static event::Logger::ptr g_logger = EVENT_LOG_NAME("system");
+
+    static int io_uring_setup(unsigned entries, io_uring_params *params)
+    {
+        return (int)syscall(__NR_io_uring_setup, entries, params);
+    }
+
+    static int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0);
+    }
+
+    static int io_uring_register(int ring_fd, unsigned opcode, void *arg, unsigned nr_args)
+    {
+        return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+    }
+
+    UringIO::UringIO(IOManager *iom, uint32_t entries)
+        : m_iom(iom)
+    {
+        EVENT_ASSERT(iom);
+
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        m_ringFd = io_uring_setup(entries, &params);
+        EVENT_ASSERT2(m_ringFd >= 0, "io_uring_setup errno=" << errno);
+        m_entries = params.sq_entries;
+
+        // 映射SQ环、CQ环和SQE数组，新内核SQ/CQ共用一块映射
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap)
+        {
+            m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+        }
+        m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+        EVENT_ASSERT(m_sqRing != MAP_FAILED);
+        if (single_mmap)
+        {
+            m_cqRing = m_sqRing;
+        }
+        else
+        {
+            m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+            EVENT_ASSERT(m_cqRing != MAP_FAILED);
+        }
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = (io_uring_sqe *)mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+        EVENT_ASSERT(m_sqes != MAP_FAILED);
+
+        char *sq = (char *)m_sqRing;
+        m_sqHead = (uint32_t *)(sq + params.sq_off.head);
+        m_sqTail = (uint32_t *)(sq + params.sq_off.tail);
+        m_sqMask = (uint32_t *)(sq + params.sq_off.ring_mask);
+        m_sqArray = (uint32_t *)(sq + params.sq_off.array);
+        char *cq = (char *)m_cqRing;
+        m_cqHead = (uint32_t *)(cq + params.cq_off.head);
+        m_cqTail = (uint32_t *)(cq + params.cq_off.tail);
+        m_cqMask = (uint32_t *)(cq + params.cq_off.ring_mask);
+        m_cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+
+        // 完成通知走eventfd，持久注册进宿主的epoll循环，
+        // CQE到达时完成回调被调度，IO分发复用既有的就绪机制
+        m_eventFd = eventfd(0, EFD_NONBLOCK);
+        EVENT_ASSERT(m_eventFd >= 0);
+        int rt = io_uring_register(m_ringFd, IORING_REGISTER_EVENTFD, &m_eventFd, 1);
+        EVENT_ASSERT2(!rt, "io_uring_register errno=" << errno);
+        rt = m_iom->addEvent(m_eventFd, IOManager::READ,
+                             std::bind(&UringIO::reapCompletions, this), true);
+        EVENT_ASSERT(!rt);
+    }
+
+    UringIO::~UringIO()
+    {
+        EVENT_ASSERT(m_inflight == 0);
+        m_iom->delEvent(m_eventFd, IOManager::READ);
+        munmap(m_sqes, m_sqesSize);
+        if (m_cqRing != m_sqRing)
+        {
+            munmap(m_cqRing, m_cqRingSize);
+        }
+        munmap(m_sqRing, m_sqRingSize);
+        close(m_eventFd);
+        close(m_ringFd);
+    }
+
+    ssize_t UringIO::readAsync(int fd, void *buf, size_t len, uint64_t offset)
+    {
+        return submitOp(IORING_OP_READ, fd, buf, len, offset);
+    }
+
+    ssize_t UringIO::writeAsync(int fd, const void *buf, size_t len, uint64_t offset)
+    {
+        return submitOp(IORING_OP_WRITE, fd, buf, len, offset);
+    }
+
+    ssize_t UringIO::submitOp(uint8_t opcode, int fd, const void *buf, size_t len, uint64_t offset)
+    {
+        // 必须在调度线程的协程里调用，完成后协程被重新调度
+        EVENT_ASSERT(Scheduler::GetThis());
+
+        // 上下文放堆上：完成回调按地址写结果，不能指向协程栈，
+        // 共享栈协程yield后栈内容会被搬走
+        std::unique_ptr<UringOp> op(new UringOp);
+        op->cor = Cor::GetThis();
+        op->scheduler = Scheduler::GetThis();
+        ++m_inflight;
+
+        {
+            MutexType::Lock lock(m_mutex);
+            uint32_t head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+            uint32_t tail = *m_sqTail;
+            if (tail - head >= m_entries)
+            {
+                // SQ满说明在途IO已到上限，返回繁忙让调用方退避
+                --m_inflight;
+                errno = EBUSY;
+                return -1;
+            }
+            uint32_t idx = tail & *m_sqMask;
+            io_uring_sqe *sqe = &m_sqes[idx];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = opcode;
+            sqe->fd = fd;
+            sqe->addr = (uint64_t)(uintptr_t)buf;
+            sqe->len = (uint32_t)len;
+            sqe->off = offset;
+            sqe->user_data = (uint64_t)(uintptr_t)op.get();
+            m_sqArray[idx] = idx;
+            __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+            ++m_toSubmit;
+
+            // 一次enter带走所有并发填充的SQE，多个协程的提交合并成一次系统调用
+            int rt;
+            do
+            {
+                rt = io_uring_enter(m_ringFd, m_toSubmit, 0, 0);
+            } while (rt < 0 && errno == EINTR);
+            EVENT_ASSERT2(rt >= 0, "io_uring_enter errno=" << errno);
+            m_toSubmit -= rt;
+        }
+
+        // 挂起，CQE到达时由完成回调重新调度本协程
+        Cor::GetThis()->yield();
+
+        --m_inflight;
+        if (op->res < 0)
+        {
+            errno = -op->res;
+            return -1;
+        }
+        return op->res;
+    }
+
+    void UringIO::reapCompletions()
+    {
+        // eventfd的持久回调可能在多个线程上并发，收割必须串行
+        MutexType::Lock lock(m_cqMutex);
+
+        // 先清eventfd计数再收割，晚到的完成会再次触发回调，不会丢
+        uint64_t dummy = 0;
+        while (read(m_eventFd, &dummy, sizeof(dummy)) > 0)
+            ;
+
+        uint32_t head = *m_cqHead;
+        while (true)
+        {
+            uint32_t tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+            if (head == tail)
+            {
+                break;
+            }
+            io_uring_cqe *cqe = &m_cqes[head & *m_cqMask];
+            UringOp *op = (UringOp *)(uintptr_t)cqe->user_data;
+            // 先写结果再调度，协程resume后op随即可能被释放，之后不再触碰
+            op->res = cqe->res;
+            Scheduler *scheduler = op->scheduler;
+            Cor::ptr cor;
+            cor.swap(op->cor);
+            ++head;
+            __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+            // 提交协程可能还没完成切换，等到READY再调度。READY由它那侧的
+            // resume()在现场保存完毕后才发布（见Cor::resume），和CoMutex的
+            // 唤醒端同一套机制，读到READY即可安全resume
+            while (cor->getState() == Cor::RUNNING)
+            {
+                sched_yield();
+            }
+            scheduler->schedule(cor);
+        }
+    }
+
+} /// end namespace event
+
+#endif // EVENT_IO_URING
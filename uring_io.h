@@ -0,0 +1,142 @@
+/**
+ * @file uring_io.h
+ * @brief io_uring异步IO
+ * @details 编译时定义EVENT_IO_URING启用，需要5.6以上内核
+ * @version 0.1
+ * @date 2024-06-14
+ */
+
+#ifndef __EVENT_URING_IO_H__
+#define __EVENT_URING_IO_H__
+
+#ifdef EVENT_IO_URING
+
+#include <linux/io_uring.h>
+#include "iomanager.h"
+
+namespace event
+{
+
+    /**
+     * @brief io_uring异步IO，epoll就绪回调模型的补充数据通路
+     * @details 就绪+系统调用的模型每次IO要进两次内核：epoll_wait报告
+     * 就绪，协程再发起真正的read/write。io_uring把"做什么IO"直接提交给
+     * 内核，数据就绪后由内核完成拷贝，协程只在CQE到达时被唤醒一次。
+     * readAsync/writeAsync提交SQE后挂起当前协程，完成事件经io_uring注册
+     * 的eventfd走既有的addEvent持久注册进到epoll循环，由完成回调批量收割
+     * CQE并重新调度挂起的协程——事件分发、定时器、调度器停止判断都复用
+     * epoll那一套，io_uring只接管数据路径。SQE在锁内填充、一次
+     * io_uring_enter带走所有并发填充的SQE，高并发下摊薄到每请求
+     * 不足一次系统调用
+     * @attention 协程在CQE到达前挂起，IO上下文分配在堆上，
+     * 共享栈协程也可以安全使用
+     */
+    class UringIO
+    {
+    public:
+        typedef std::shared_ptr<UringIO> ptr;
+        typedef Mutex MutexType;
+
+        /**
+         * @brief 构造函数，创建io_uring实例并把完成eventfd挂进iom的epoll
+         * @param[in] iom 宿主IO调度器，完成回调经它的epoll循环分发
+         * @param[in] entries SQ深度，向上取2的幂，也是在途IO数的上限
+         */
+        explicit UringIO(IOManager *iom, uint32_t entries = 256);
+
+        /**
+         * @brief 析构函数，要求没有在途的IO
+         */
+        ~UringIO();
+
+        /**
+         * @brief 异步读，挂起当前协程直到内核完成读取
+         * @param[in] fd 文件句柄，socket传offset=0
+         * @param[out] buf 读缓冲区
+         * @param[in] len 缓冲区字节数
+         * @param[in] offset 文件偏移，socket忽略
+         * @return 同read，读到的字节数，-1表示出错并置errno
+         */
+        ssize_t readAsync(int fd, void *buf, size_t len, uint64_t offset = 0);
+
+        /**
+         * @brief 异步写，挂起当前协程直到内核完成写入
+         * @param[in] fd 文件句柄，socket传offset=0
+         * @param[in] buf 写缓冲区
+         * @param[in] len 写入字节数
+         * @param[in] offset 文件偏移，socket忽略
+         * @return 同write，写入的字节数，-1表示出错并置errno
+         */
+        ssize_t writeAsync(int fd, const void *buf, size_t len, uint64_t offset = 0);
+
+    private:
+        /**
+         * @brief 一次在途IO的上下文，地址放进SQE的user_data，
+         * CQE到达时由完成回调写入结果并唤醒协程
+         */
+        struct UringOp
+        {
+            /// 提交IO后挂起的协程
+            Cor::ptr cor;
+            /// 挂起协程所属的调度器
+            Scheduler *scheduler = nullptr;
+            /// CQE的结果，负值为-errno
+            int32_t res = 0;
+        };
+
+        /**
+         * @brief 填充一个SQE并提交，挂起当前协程等待完成
+         * @param[in] opcode IORING_OP_READ或IORING_OP_WRITE
+         */
+        ssize_t submitOp(uint8_t opcode, int fd, const void *buf, size_t len, uint64_t offset);
+
+        /**
+         * @brief 完成回调，收割CQ上全部已完成的CQE并重新调度挂起的协程
+         * @details 注册为完成eventfd的持久READ回调，每次eventfd就绪被调度一次
+         */
+        void reapCompletions();
+
+    private:
+        /// 宿主IO调度器
+        IOManager *m_iom;
+        /// io_uring实例fd
+        int m_ringFd = -1;
+        /// 完成通知eventfd，注册进宿主的epoll
+        int m_eventFd = -1;
+        /// SQ深度
+        uint32_t m_entries = 0;
+
+        /// SQ环映射
+        void *m_sqRing = nullptr;
+        size_t m_sqRingSize = 0;
+        /// SQE数组映射
+        io_uring_sqe *m_sqes = nullptr;
+        size_t m_sqesSize = 0;
+        uint32_t *m_sqHead = nullptr;
+        uint32_t *m_sqTail = nullptr;
+        uint32_t *m_sqMask = nullptr;
+        uint32_t *m_sqArray = nullptr;
+
+        /// CQ环映射，内核支持单映射特性时与SQ环同一块
+        void *m_cqRing = nullptr;
+        size_t m_cqRingSize = 0;
+        uint32_t *m_cqHead = nullptr;
+        uint32_t *m_cqTail = nullptr;
+        uint32_t *m_cqMask = nullptr;
+        io_uring_cqe *m_cqes = nullptr;
+
+        /// 保护SQE的填充和提交
+        MutexType m_mutex;
+        /// 已填充未被内核消费的SQE数，一次enter整批带走
+        uint32_t m_toSubmit = 0;
+        /// 保护CQ的收割，完成回调可能在多个线程上并发
+        MutexType m_cqMutex;
+        /// 在途IO数，析构时校验归零
+        std::atomic<size_t> m_inflight = {0};
+    };
+
+} /// end namespace event
+
+#endif // EVENT_IO_URING
+
+#endif
@@ -0,0 +1,155 @@
+/**
+ * @file work_steal_queue.h
+ * @brief 工作窃取队列
+ * @details Chase-Lev风格的有界双端队列，属主线程在底端无锁push/pop，
+ * 其他线程从顶端steal，只有pop/steal在最后一个元素上竞争时才走CAS。
+ * 队列中保存元素指针，元素本身的生命周期由取走它的一方负责
+ * @version 0.1
+ * @date 2024-05-28
+ */
+
+#ifndef __EVENT_WORK_STEAL_QUEUE_H__
+#define __EVENT_WORK_STEAL_QUEUE_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace event
+{
+
+    /**
+     * @brief 工作窃取队列
+     * @tparam T 元素类型，队列中保存T*
+     */
+    template <class T>
+    class WorkStealQueue
+    {
+    public:
+        /**
+         * @brief 构造函数
+         * @param[in] capacity 队列容量，向上取整到2的幂，队列满时push失败，
+         * 由调用方退回共享队列
+         */
+        WorkStealQueue(size_t capacity = 8192)
+        {
+            size_t cap = 1;
+            while (cap < capacity)
+            {
+                cap <<= 1;
+            }
+            m_capacity = cap;
+            m_mask = cap - 1;
+            m_buffer = new std::atomic<T *>[cap];
+        }
+
+        ~WorkStealQueue()
+        {
+            delete[] m_buffer;
+        }
+
+        WorkStealQueue(const WorkStealQueue &) = delete;
+        WorkStealQueue &operator=(const WorkStealQueue &) = delete;
+
+        /**
+         * @brief 属主线程从底端入队
+         * @return 队列满返回false，由调用方另行处理该元素
+         */
+        bool push(T *val)
+        {
+            int64_t b = m_bottom.load(std::memory_order_relaxed);
+            int64_t t = m_top.load(std::memory_order_acquire);
+            if (b - t >= (int64_t)m_capacity)
+            {
+                return false;
+            }
+            m_buffer[b & m_mask].store(val, std::memory_order_relaxed);
+            // release保证steal线程看到bottom更新时元素已写入
+            m_bottom.store(b + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * @brief 属主线程从底端出队，LIFO顺序，缓存友好
+         * @return 队列空返回nullptr
+         */
+        T *pop()
+        {
+            // 下标必须是有符号的：空队列上bottom先减后查，b会短暂落到t-1，
+            // 首次调用时即为-1，无符号下标在这里会回绕并读到从未写入的槽位
+            int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+            m_bottom.store(b, std::memory_order_relaxed);
+            // 全序fence，保证先写bottom再读top，与steal中的CAS构成同步
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = m_top.load(std::memory_order_relaxed);
+
+            if (t > b)
+            {
+                // 队列已空，恢复bottom
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            T *val = m_buffer[b & m_mask].load(std::memory_order_relaxed);
+            if (t == b)
+            {
+                // 只剩最后一个元素，与steal竞争，CAS定胜负
+                if (!m_top.compare_exchange_strong(t, t + 1,
+                                                   std::memory_order_seq_cst,
+                                                   std::memory_order_relaxed))
+                {
+                    val = nullptr;
+                }
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return val;
+        }
+
+        /**
+         * @brief 其他线程从顶端窃取，FIFO顺序
+         * @return 队列空或竞争失败返回nullptr，竞争失败由调用方换个victim重试
+         */
+        T *steal()
+        {
+            int64_t t = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = m_bottom.load(std::memory_order_acquire);
+            if (t >= b)
+            {
+                return nullptr;
+            }
+            T *val = m_buffer[t & m_mask].load(std::memory_order_relaxed);
+            if (!m_top.compare_exchange_strong(t, t + 1,
+                                               std::memory_order_seq_cst,
+                                               std::memory_order_relaxed))
+            {
+                return nullptr;
+            }
+            return val;
+        }
+
+        /**
+         * @brief 队列是否为空，仅供启发式判断，结果可能立即过期
+         */
+        bool empty() const
+        {
+            return m_top.load(std::memory_order_relaxed) >=
+                   m_bottom.load(std::memory_order_relaxed);
+        }
+
+    private:
+        /// 环形缓冲区，保存元素指针
+        std::atomic<T *> *m_buffer = nullptr;
+        /// 容量，2的幂
+        size_t m_capacity = 0;
+        /// 下标掩码
+        size_t m_mask = 0;
+        /// 顶端下标，steal端，只增不减。有符号，见pop()中的说明
+        std::atomic<int64_t> m_top{0};
+        /// 底端下标，属主端
+        std::atomic<int64_t> m_bottom{0};
+    };
+
+} // namespace event
+
+#endif